@@ -0,0 +1,531 @@
+/**
+ * \file
+ *
+ * \brief Medidas dos servicos basicos do sistema multitarefas.
+ *
+ * Compilado apenas com BENCHMARK definido: configuracao Benchmark do as_d21.cproj
+ * ou "make bench" no porte Linux (rtos/linux). Mede, em ciclos de clock da CPU:
+ *
+ *  - troca_ida_volta: TarefaContinua de uma tarefa de maior prioridade, que volta
+ *    a se suspender (duas trocas de contexto). Comparar cfg_TEMPO_DE_EXECUCAO em 0 e 1
+ *    (indicado no cabecalho) para ver o custo de ler o contador de tempo em cada troca;
+ *  - continua_tarefa: de TarefaContinua ate a tarefa continuada executar;
+ *  - semaforo_libera_aguarda: de SemaforoLibera ate a tarefa que esperava em
+ *    SemaforoAguarda executar;
+ *  - notificacao_libera_recebe: o mesmo com TarefaNotificaLibera e TarefaNotificacaoRecebe,
+ *    para comparar a notificacao direta com o semaforo;
+ *  - espera_jitter: atraso entre a marca de tempo e a volta da tarefa de TarefaEspera(1),
+ *    isto e, da interrupcao ate a tarefa;
+ *  - escalonador_x100: 100 chamadas do escalonador (busca da tarefa pronta de maior 
+ *    prioridade), para comparar PRIORIDADE_MAXIMA igual a 3, 31 e 255 (4, 32 e 256 niveis);
+ *  - fatia_troca: troca entre duas tarefas de mesma prioridade no fim da fatia de tempo,
+ *    da ultima instrucao de uma ate a primeira da outra. As amostras sao as trocas em
+ *    JANELA_FATIA marcas de tempo, entao a fracao da CPU gasta nas trocas e
+ *    amostras * media / (JANELA_FATIA * clock_hz / marca_hz). Comparar cfg_FATIA_TEMPO
+ *    igual a 1 e 10 (indicado no cabecalho);
+ *  - produtor_consumidor: por mensagem, do produtor (tarefa mestre) ate um dos
+ *    CONSUMIDORES_BENCHMARK consumidores de maior prioridade, pelo buffer com os semaforos
+ *    de cheio e vazio. Os consumidores esperam juntos no semaforo de cheio: comparar 1, 4
+ *    e 16 consumidores, por exemplo make bench CONFIG=-DCONSUMIDORES_BENCHMARK=16;
+ *  - fila_mensagem: o mesmo por uma fila de mensagens de 32 bits, com um consumidor.
+ *    Comparar com produtor_consumidor com CONSUMIDORES_BENCHMARK=1; a vazao em 
+ *    mensagens por segundo e clock_hz / media;
+ *  - memoria_aloca_libera_x100 e malloc_free_x100: 100 vezes alocar e liberar um bloco de 
+ *    TAM_BLOCO_BENCHMARK bytes de um conjunto de blocos e com malloc/free. Entre as amostras 
+ *    o heap e fragmentado, trocando blocos guardados por blocos de outros tamanhos;
+ *  - tarefa_cria: de CriaTarefaDinamica ate a nova tarefa, de maior prioridade e com a
+ *    pilha de um conjunto de blocos, comecar a executar;
+ *  - tarefa_termina: do retorno da funcao dessa tarefa ate a tarefa mestre voltar a
+ *    executar. A pilha e devolvida depois, pela tarefa ociosa.
+ *
+ * Os ciclos sao lidos do SysTick (no Linux, um SysTick simulado pelo relogio do sistema),
+ * que conta para baixo e recarrega a cada marca de tempo, entao cada medida deve ser menor
+ * que uma marca de tempo. O custo da propria leitura e descontado.
+ *
+ * O resultado e impresso com printf em linhas CSV (nome,amostras,min,media,max), para
+ * comparar execucoes de versoes diferentes, e tambem fica no vetor Resultados, que pode
+ * ser lido pelo depurador. Para medir o ganho das funcoes e dos vetores na SRAM, comparar
+ * as execucoes com cfg_FUNCOES_NA_RAM e cfg_VETORES_NA_RAM em 0 e em 1 (indicados no cabecalho).
+ */
+
+#ifdef BENCHMARK
+
+#include <asf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "stdint.h"
+#include "rtos.h"
+
+/* numero de amostras de cada medida */
+#ifndef AMOSTRAS_BENCHMARK
+#define AMOSTRAS_BENCHMARK	1000
+#endif
+
+/* chamadas por amostra nas medidas de funcoes muito curtas, para que a resolucao do 
+   SysTick (no Linux, a do relogio do sistema) nao domine a medida */
+#define REPETICOES_BENCHMARK	100
+
+/* marcas de tempo em que as tarefas da medida das fatias de tempo dividem a CPU */
+#define JANELA_FATIA			AMOSTRAS_BENCHMARK
+
+/* consumidores do buffer da medida produtor_consumidor */
+#ifndef CONSUMIDORES_BENCHMARK
+#define CONSUMIDORES_BENCHMARK	4
+#endif
+
+/* mensagens produzidas por amostra da medida produtor_consumidor */
+#define MENSAGENS_BENCHMARK		10
+
+#define TAM_BUFFER_BENCHMARK	16
+
+/* blocos das medidas de alocacao de memoria */
+#define TAM_BLOCO_BENCHMARK		48
+#define BLOCOS_BENCHMARK		8
+
+/* mestre, eco, duas tarefas da fatia de tempo, os consumidores do buffer e da fila, 
+   a tarefa criada sob demanda e a ociosa */
+#define TAREFAS_BENCHMARK		(7 + CONSUMIDORES_BENCHMARK)
+
+#if NUMERO_DE_TAREFAS < TAREFAS_BENCHMARK
+#error "o benchmark precisa de NUMERO_DE_TAREFAS >= TAREFAS_BENCHMARK"
+#endif
+
+typedef struct
+{
+	const char	*nome;
+	uint32_t	amostras;
+	uint32_t	min;
+	uint32_t	max;
+	uint32_t	soma;
+} medida_t;
+
+typedef enum
+{
+	MEDIDA_TROCA,
+	MEDIDA_CONTINUA,
+	MEDIDA_SEMAFORO,
+	MEDIDA_NOTIFICACAO,
+	MEDIDA_ESPERA,
+	MEDIDA_ESCALONADOR,
+	MEDIDA_FATIA,
+	MEDIDA_PRODUTOR_CONSUMIDOR,
+	MEDIDA_FILA,
+	MEDIDA_MEMORIA,
+	MEDIDA_MALLOC,
+	MEDIDA_CRIA,
+	MEDIDA_TERMINA,
+	NUMERO_MEDIDAS
+} id_medida_t;
+
+medida_t Resultados[NUMERO_MEDIDAS] =
+{
+	{"troca_ida_volta", 0, 0xFFFFFFFFul, 0, 0},
+	{"continua_tarefa", 0, 0xFFFFFFFFul, 0, 0},
+	{"semaforo_libera_aguarda", 0, 0xFFFFFFFFul, 0, 0},
+	{"notificacao_libera_recebe", 0, 0xFFFFFFFFul, 0, 0},
+	{"espera_jitter", 0, 0xFFFFFFFFul, 0, 0},
+	{"escalonador_x100", 0, 0xFFFFFFFFul, 0, 0},
+	{"fatia_troca", 0, 0xFFFFFFFFul, 0, 0},
+	{"produtor_consumidor", 0, 0xFFFFFFFFul, 0, 0},
+	{"fila_mensagem", 0, 0xFFFFFFFFul, 0, 0},
+	{"memoria_aloca_libera_x100", 0, 0xFFFFFFFFul, 0, 0},
+	{"malloc_free_x100", 0, 0xFFFFFFFFul, 0, 0},
+	{"tarefa_cria", 0, 0xFFFFFFFFul, 0, 0},
+	{"tarefa_termina", 0, 0xFFFFFFFFul, 0, 0},
+};
+
+/*
+ * Prototipos das tarefas
+ */
+void tarefa_mestre(void);
+void tarefa_eco(void);
+void tarefa_fatia(void);
+void tarefa_consumidor(void);
+void tarefa_fila(void);
+void tarefa_sob_demanda(void);
+
+/*
+ * Configuracao dos tamanhos das pilhas
+ */
+#define TAM_PILHA_MESTRE	(TAM_MINIMO_PILHA + 256)	/* printf */
+#define TAM_PILHA_ECO		(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_OCIOSA	(TAM_MINIMO_PILHA + 24)
+
+/*
+ * Pilhas das tarefas
+ */
+uint32_t PILHA_MESTRE[TAM_PILHA_MESTRE];
+uint32_t PILHA_ECO[TAM_PILHA_ECO];
+uint32_t PILHA_FATIA[2][TAM_PILHA_ECO];
+uint32_t PILHA_CONSUMIDOR[CONSUMIDORES_BENCHMARK][TAM_PILHA_ECO];
+uint32_t PILHA_FILA[TAM_PILHA_ECO];
+uint32_t PILHA_OCIOSA_BENCHMARK[TAM_PILHA_OCIOSA];
+
+semaforo_t SemaforoBenchmark = {0, 0};
+semaforo_t SemaforoCheioBenchmark = {0, 0};
+semaforo_t SemaforoVazioBenchmark = {TAM_BUFFER_BENCHMARK, 0};
+
+FILA_DECLARA(FilaBenchmark, uint32_t, TAM_BUFFER_BENCHMARK);
+
+MEMORIA_DECLARA(MemoriaBenchmark, TAM_BLOCO_BENCHMARK, BLOCOS_BENCHMARK);
+MEMORIA_DECLARA(PilhasBenchmark, TAM_PILHA_ECO * sizeof(uint32_t), 1);
+
+/* volatile para o compilador nao eliminar o par malloc/free */
+static void * volatile bloco_malloc;
+
+static uint8_t buffer[TAM_BUFFER_BENCHMARK];
+static uint8_t indice_consumidores = 0;
+
+static uint8_t id_eco;
+/* como a tarefa eco espera entre as respostas */
+typedef enum {ECO_SUSPENSA, ECO_SEMAFORO, ECO_NOTIFICACAO} modo_eco_t;
+
+static volatile uint8_t modo_eco = ECO_SUSPENSA;
+static volatile uint32_t fim_eco;
+static volatile uint32_t inicio_sob_demanda, fim_sob_demanda;
+static uint32_t custo_leitura;
+
+static uint8_t id_fatia[2];
+static volatile uint8_t ultima_fatia = 0;
+static volatile uint32_t fim_fatia;
+
+/* o SysTick conta para baixo */
+#define LE_CICLOS()		(*(NVIC_SYSTICK_VAL))
+
+/* ciclos entre duas leituras do SysTick, considerando uma recarga entre elas */
+static uint32_t ciclos(uint32_t inicio, uint32_t fim)
+{
+	uint32_t decorrido;
+
+	if(inicio >= fim)
+	{
+		decorrido = inicio - fim;
+	}else
+	{
+		decorrido = inicio + (*(NVIC_SYSTICK_LOAD) + 1) - fim;
+	}
+	return (decorrido > custo_leitura) ? (decorrido - custo_leitura) : 0;
+}
+
+static void registra(id_medida_t id, uint32_t valor)
+{
+	medida_t *m = &Resultados[id];
+
+	m->amostras++;
+	m->soma += valor;
+	if(valor < m->min)
+	{
+		m->min = valor;
+	}
+	if(valor > m->max)
+	{
+		m->max = valor;
+	}
+}
+
+/* menor custo de duas leituras seguidas do SysTick */
+static void calibra(void)
+{
+	uint32_t i, inicio, fim, menor = 0xFFFFFFFFul;
+
+	custo_leitura = 0;
+	for(i = 0; i < 100; i++)
+	{
+		inicio = LE_CICLOS();
+		fim = LE_CICLOS();
+		if(ciclos(inicio, fim) < menor)
+		{
+			menor = ciclos(inicio, fim);
+		}
+	}
+	custo_leitura = menor;
+}
+
+/* comeca cada medida logo depois de uma marca de tempo, para que ela caiba na marca */
+static void sincroniza(void)
+{
+	TarefaEspera(1);
+}
+
+static void imprime(void)
+{
+	uint8_t i;
+
+	printf("# benchmark rtos: clock_hz=%lu marca_hz=%u amostras=%u custo_leitura=%lu funcoes_na_ram=%u vetores_na_ram=%u ram_por_tarefa=%u"
+		" prioridade_maxima=%u fatia_tempo=%u consumidores=%u tempo_de_execucao=%u\n",
+		(unsigned long)cfg_CPU_CLOCK_HZ, (unsigned)cfg_MARCA_TEMPO_HZ, (unsigned)AMOSTRAS_BENCHMARK, (unsigned long)custo_leitura,
+		(unsigned)cfg_FUNCOES_NA_RAM, (unsigned)cfg_VETORES_NA_RAM, (unsigned)RAM_POR_TAREFA, (unsigned)PRIORIDADE_MAXIMA, (unsigned)cfg_FATIA_TEMPO,
+		(unsigned)CONSUMIDORES_BENCHMARK, (unsigned)cfg_TEMPO_DE_EXECUCAO);
+	printf("nome,amostras,min,media,max\n");
+	for(i = 0; i < NUMERO_MEDIDAS; i++)
+	{
+		medida_t *m = &Resultados[i];
+		printf("%s,%lu,%lu,%lu,%lu\n", m->nome, (unsigned long)m->amostras, (unsigned long)m->min,
+			(unsigned long)(m->amostras ? m->soma / m->amostras : 0), (unsigned long)m->max);
+	}
+	fflush(stdout);
+}
+
+int main(void)
+{
+	/* Criacao das tarefas */
+	/* Parametros: ponteiro, nome, ponteiro da pilha, tamanho da pilha, prioridade da tarefa */
+	CriaTarefa(tarefa_mestre, "Mestre", PILHA_MESTRE, TAM_PILHA_MESTRE, 1);
+	id_eco = CriaTarefa(tarefa_eco, "Eco", PILHA_ECO, TAM_PILHA_ECO, 2);
+	id_fatia[0] = CriaTarefa(tarefa_fatia, "Fatia A", PILHA_FATIA[0], TAM_PILHA_ECO, 1);
+	id_fatia[1] = CriaTarefa(tarefa_fatia, "Fatia B", PILHA_FATIA[1], TAM_PILHA_ECO, 1);
+	for(uint8_t c = 0; c < CONSUMIDORES_BENCHMARK; c++)
+	{
+		CriaTarefa(tarefa_consumidor, "Consumidor", PILHA_CONSUMIDOR[c], TAM_PILHA_ECO, 2);
+	}
+	CriaTarefa(tarefa_fila, "Fila", PILHA_FILA, TAM_PILHA_ECO, 2);
+
+	/* Cria tarefa ociosa do sistema */
+	CriaTarefa(tarefa_ociosa, "Tarefa ociosa", PILHA_OCIOSA_BENCHMARK, TAM_PILHA_OCIOSA, 0);
+
+	/* Configura a marca de tempo e inicia o escalonador */
+	ConfiguraMarcaTempo();
+	IniciaMultitarefas();
+
+	/* O codigo nao devera alcancar este ponto */
+	while(1);
+}
+
+/* Tarefa de maior prioridade que apenas responde a tarefa mestre: guarda o instante
+ * em que voltou a executar e espera de novo, suspensa, no semaforo ou pela notificacao */
+void tarefa_eco(void)
+{
+	for(;;)
+	{
+		if(modo_eco == ECO_SEMAFORO)
+		{
+			SemaforoAguarda(&SemaforoBenchmark);
+		}else if(modo_eco == ECO_NOTIFICACAO)
+		{
+			(void)TarefaNotificacaoRecebe(1, ESPERA_INFINITA);
+		}else
+		{
+			TarefaSuspende(id_eco);
+		}
+		fim_eco = LE_CICLOS();
+	}
+}
+
+/* Duas instancias com a prioridade da tarefa mestre, que nunca liberam a CPU: so trocam
+ * no fim da fatia de tempo. Cada uma guarda a ultima leitura do SysTick e, ao perceber
+ * que a CPU veio da outra, registra o tempo desde a ultima leitura da outra */
+void tarefa_fatia(void)
+{
+	uint32_t agora;
+
+	TarefaSuspende(tarefa_atual);
+	for(;;)
+	{
+		agora = LE_CICLOS();
+		if(ultima_fatia != tarefa_atual)
+		{
+			REG_ATOMICA_INICIO();
+			if(ultima_fatia != 0)
+			{
+				registra(MEDIDA_FATIA, ciclos(fim_fatia, agora));
+			}
+			ultima_fatia = tarefa_atual;
+			REG_ATOMICA_FIM();
+		}
+		fim_fatia = agora;
+	}
+}
+
+/* Consumidores do buffer, de maior prioridade que o produtor: cada SemaforoLibera do 
+ * produtor acorda o primeiro da lista de espera do semaforo de cheio */
+void tarefa_consumidor(void)
+{
+	uint8_t valor;
+
+	for(;;)
+	{
+		SemaforoAguarda(&SemaforoCheioBenchmark);
+
+		REG_ATOMICA_INICIO();		/* o indice de leitura e compartilhado entre os consumidores */
+		valor = buffer[indice_consumidores];
+		indice_consumidores = (indice_consumidores + 1) % TAM_BUFFER_BENCHMARK;
+		REG_ATOMICA_FIM();
+
+		(void)valor;
+		SemaforoLibera(&SemaforoVazioBenchmark);
+	}
+}
+
+/* Consumidor da fila de mensagens, de maior prioridade que o produtor */
+void tarefa_fila(void)
+{
+	uint32_t mensagem;
+
+	for(;;)
+	{
+		(void)FilaRecebe(&FilaBenchmark, &mensagem, ESPERA_INFINITA);
+	}
+}
+
+/* Tarefa criada pela tarefa mestre a cada amostra: guarda quando comecou e quando
+ * terminou. Ao retornar, e excluida */
+void tarefa_sob_demanda(void)
+{
+	inicio_sob_demanda = LE_CICLOS();
+	fim_sob_demanda = LE_CICLOS();
+}
+
+void tarefa_mestre(void)
+{
+	uint32_t n, r, inicio, fim;
+	uint8_t i = 0;
+	void *bloco;
+	void *guardados[BLOCOS_BENCHMARK / 2] = {0};
+
+	calibra();
+
+	/* a tarefa eco se suspendeu ao iniciar: TarefaContinua troca para ela e ela
+	   volta a se suspender, trocando de volta */
+	for(n = 0; n < AMOSTRAS_BENCHMARK; n++)
+	{
+		sincroniza();
+		inicio = LE_CICLOS();
+		TarefaContinua(id_eco);
+		fim = LE_CICLOS();
+		registra(MEDIDA_TROCA, ciclos(inicio, fim));
+		registra(MEDIDA_CONTINUA, ciclos(inicio, fim_eco));
+	}
+
+	/* a tarefa eco passa a esperar no semaforo */
+	modo_eco = ECO_SEMAFORO;
+	TarefaContinua(id_eco);
+	for(n = 0; n < AMOSTRAS_BENCHMARK; n++)
+	{
+		sincroniza();
+		inicio = LE_CICLOS();
+		SemaforoLibera(&SemaforoBenchmark);
+		registra(MEDIDA_SEMAFORO, ciclos(inicio, fim_eco));
+	}
+
+	/* a tarefa eco passa a esperar pela notificacao */
+	modo_eco = ECO_NOTIFICACAO;
+	SemaforoLibera(&SemaforoBenchmark);
+	for(n = 0; n < AMOSTRAS_BENCHMARK; n++)
+	{
+		sincroniza();
+		inicio = LE_CICLOS();
+		TarefaNotificaLibera(id_eco);
+		registra(MEDIDA_NOTIFICACAO, ciclos(inicio, fim_eco));
+	}
+
+	/* a tarefa mestre e a unica pronta alem da ociosa: volta logo depois da marca de tempo */
+	for(n = 0; n < AMOSTRAS_BENCHMARK; n++)
+	{
+		TarefaEspera(1);
+		fim = LE_CICLOS();
+		registra(MEDIDA_ESPERA, ciclos(*(NVIC_SYSTICK_LOAD), fim));
+	}
+	
+	/* o escalonador so le o mapa de prioridades prontas e pode ser chamado fora da troca
+	   de contexto. Com o mapa de bits o custo nao depende de PRIORIDADE_MAXIMA */
+	for(n = 0; n < AMOSTRAS_BENCHMARK; n++)
+	{
+		sincroniza();
+		REG_ATOMICA_INICIO();
+		inicio = LE_CICLOS();
+		for(r = 0; r < REPETICOES_BENCHMARK; r++)
+		{
+			(void)escalonador();
+		}
+		fim = LE_CICLOS();
+		REG_ATOMICA_FIM();
+		registra(MEDIDA_ESCALONADOR, ciclos(inicio, fim));
+	}
+
+	/* as tarefas da fatia de tempo se suspenderam ao iniciar e tem a mesma prioridade:
+	   continua-las nao troca de contexto. Enquanto a mestre espera, so elas executam */
+	TarefaContinua(id_fatia[0]);
+	TarefaContinua(id_fatia[1]);
+	TarefaEspera(JANELA_FATIA);
+	TarefaSuspende(id_fatia[0]);
+	TarefaSuspende(id_fatia[1]);
+
+	/* a tarefa mestre e o produtor */
+	for(n = 0; n < AMOSTRAS_BENCHMARK; n++)
+	{
+		sincroniza();
+		inicio = LE_CICLOS();
+		for(r = 0; r < MENSAGENS_BENCHMARK; r++)
+		{
+			SemaforoAguarda(&SemaforoVazioBenchmark);
+			buffer[i] = (uint8_t)r;
+			i = (i + 1) % TAM_BUFFER_BENCHMARK;
+			SemaforoLibera(&SemaforoCheioBenchmark);
+		}
+		fim = LE_CICLOS();
+		registra(MEDIDA_PRODUTOR_CONSUMIDOR, ciclos(inicio, fim) / MENSAGENS_BENCHMARK);
+	}
+
+	/* o mesmo pela fila de mensagens */
+	for(n = 0; n < AMOSTRAS_BENCHMARK; n++)
+	{
+		sincroniza();
+		inicio = LE_CICLOS();
+		for(r = 0; r < MENSAGENS_BENCHMARK; r++)
+		{
+			(void)FilaEnvia(&FilaBenchmark, &r, ESPERA_INFINITA);
+		}
+		fim = LE_CICLOS();
+		registra(MEDIDA_FILA, ciclos(inicio, fim) / MENSAGENS_BENCHMARK);
+	}
+
+	/* o conjunto de blocos leva sempre o mesmo tempo; o malloc varia com a fragmentacao */
+	for(n = 0; n < AMOSTRAS_BENCHMARK; n++)
+	{
+		sincroniza();
+		REG_ATOMICA_INICIO();
+		inicio = LE_CICLOS();
+		for(r = 0; r < REPETICOES_BENCHMARK; r++)
+		{
+			bloco = MemoriaAloca(&MemoriaBenchmark);
+			MemoriaLibera(&MemoriaBenchmark, bloco);
+		}
+		fim = LE_CICLOS();
+		registra(MEDIDA_MEMORIA, ciclos(inicio, fim));
+
+		inicio = LE_CICLOS();
+		for(r = 0; r < REPETICOES_BENCHMARK; r++)
+		{
+			bloco_malloc = malloc(TAM_BLOCO_BENCHMARK);
+			free(bloco_malloc);
+		}
+		fim = LE_CICLOS();
+		REG_ATOMICA_FIM();
+		registra(MEDIDA_MALLOC, ciclos(inicio, fim));
+
+		/* fragmenta o heap: troca um dos blocos guardados por um de outro tamanho */
+		i = (uint8_t)(n % (BLOCOS_BENCHMARK / 2));
+		free(guardados[i]);
+		guardados[i] = malloc(TAM_BLOCO_BENCHMARK / 2 + 8 * i);
+	}
+
+	/* a tarefa criada tem maior prioridade: executa e termina dentro de CriaTarefaDinamica */
+	for(n = 0; n < AMOSTRAS_BENCHMARK; n++)
+	{
+		sincroniza();						/* a tarefa ociosa devolve a pilha da anterior */
+		inicio = LE_CICLOS();
+		if(CriaTarefaDinamica(tarefa_sob_demanda, "Sob demanda", &PilhasBenchmark, 2) == 0)
+		{
+			continue;
+		}
+		fim = LE_CICLOS();
+		registra(MEDIDA_CRIA, ciclos(inicio, inicio_sob_demanda));
+		registra(MEDIDA_TERMINA, ciclos(fim_sob_demanda, fim));
+	}
+
+	REG_ATOMICA_INICIO();
+	imprime();
+	exit(0);
+}
+
+#endif /* BENCHMARK */
@@ -8,6 +8,16 @@
 #include "cpu-port.h"
 #include "rtos.h"
 
+#if cfg_MODO_SEM_MARCA
+static void ConfiguraDespertador(void);
+#endif
+#if cfg_TEMPO_DE_EXECUCAO
+static void ConfiguraContadorTempo(void);
+#endif
+#if cfg_VETORES_NA_RAM
+static void RelocaVetores(void);
+#endif
+
 stackptr_t CriaContexto(tarefa_t endereco_tarefa, stackptr_t ptr_pilha)
 {
 	#define INITIAL_XPSR		0x01000000
@@ -15,7 +25,7 @@ stackptr_t CriaContexto(tarefa_t endereco_tarefa, stackptr_t ptr_pilha)
 	uint32_t reg_val;
 	*(--ptr_pilha) = INITIAL_XPSR;     /* xPSR */
 	*(--ptr_pilha) = (uint32_t)endereco_tarefa;  /* R15 */
-	*(--ptr_pilha) = 0x00;				   /* R14 */
+	*(--ptr_pilha) = (uint32_t)TarefaTermina;	/* R14: se a tarefa retornar, ela e excluida */
 	
 	*(--ptr_pilha) = 0x12;			   /* R12 */
 	
@@ -52,44 +62,292 @@ void ConfiguraMarcaTempo(void)
 		*(NVIC_SYSTICK_CTRL) = 0;						// Desabilita SysTick Timer
 		*(NVIC_SYSTICK_LOAD) = valor_comparador - 1;	// Configura a contagem
 		*(NVIC_SYSTICK_CTRL) = NVIC_SYSTICK_CLK | NVIC_SYSTICK_INT | NVIC_SYSTICK_ENABLE;  // Inicia
+		
+#if cfg_MODO_SEM_MARCA
+		ConfiguraDespertador();
+#endif
+
+#if cfg_TEMPO_DE_EXECUCAO
+		ConfiguraContadorTempo();
+#endif
+
+#if cfg_VETORES_NA_RAM
+		RelocaVetores();
+#endif
+}
+
+#if cfg_VETORES_NA_RAM
+/* copia da tabela de vetores na SRAM: o VTOR exige o alinhamento no tamanho da tabela
+   arredondado para potencia de 2 (45 palavras, 180 bytes -> 256) */
+static DeviceVectors vetores_ram __attribute__ ((aligned(256)));
+
+/* Copia a tabela de vetores atual (exception_table, na flash) para a SRAM e muda o VTOR,
+ * assim a busca do vetor na entrada das interrupcoes nao espera a flash */
+static void RelocaVetores(void)
+{
+	const uint32_t *origem = (const uint32_t *)(SCB->VTOR & SCB_VTOR_TBLOFF_Msk);
+	uint32_t *destino = (uint32_t *)&vetores_ram;
+	uint32_t i;
+	
+	for(i = 0; i < sizeof(DeviceVectors) / sizeof(uint32_t); i++)
+	{
+		destino[i] = origem[i];
+	}
+	
+	__DSB();
+	SCB->VTOR = ((uint32_t)&vetores_ram & SCB_VTOR_TBLOFF_Msk);
+	__DSB();
+	__ISB();
+}
+#endif
+
+#if cfg_TEMPO_DE_EXECUCAO
+/* Configura o TC4 como contador livre de 32 bits (o TC5 forma os 16 bits mais altos),
+ * com o clock do gerador 0 (clock da CPU) dividido por CONTADOR_TEMPO_DIVISOR. O COUNT
+ * e sincronizado continuamente (RCONT), assim a troca de contexto le o contador sem
+ * esperar a sincronizacao. O TC4 para no modo STANDBY */
+static void ConfiguraContadorTempo(void)
+{
+	struct system_gclk_chan_config config_canal;
+	
+	system_gclk_chan_get_config_defaults(&config_canal);
+	config_canal.source_generator = GCLK_GENERATOR_0;
+	system_gclk_chan_set_config(TC4_GCLK_ID, &config_canal);
+	system_gclk_chan_enable(TC4_GCLK_ID);
+	
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_TC4 | PM_APBCMASK_TC5);
+	
+	TC4->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
+	while(TC4->COUNT32.CTRLA.reg & TC_CTRLA_SWRST);
+	
+	TC4->COUNT32.CTRLA.reg = TC_CTRLA_MODE_COUNT32 | TC_CTRLA_PRESCALER_DIV16;
+	while(TC4->COUNT32.STATUS.reg & TC_STATUS_SYNCBUSY);
+	
+	TC4->COUNT32.READREQ.reg = TC_READREQ_RCONT | TC_READREQ_RREQ | TC_READREQ_ADDR(TC_COUNT32_COUNT_OFFSET);
+	
+	TC4->COUNT32.CTRLA.reg |= TC_CTRLA_ENABLE;
+	while(TC4->COUNT32.STATUS.reg & TC_STATUS_SYNCBUSY);
+}
+#endif
+
+#if cfg_MODO_SEM_MARCA
+/* Configura o RTC como contador livre de 32 bits, com clock de 32768 Hz do oscilador 
+ * de ultra baixo consumo (OSCULP32K) pelo gerador de clock 2. O comparador 0 do RTC 
+ * acorda a CPU no fim do tempo ocioso, mesmo no modo STANDBY */
+static void ConfiguraDespertador(void)
+{
+	struct system_gclk_gen_config config_gerador;
+	struct system_gclk_chan_config config_canal;
+	
+	system_gclk_gen_get_config_defaults(&config_gerador);
+	config_gerador.source_clock = SYSTEM_CLOCK_SOURCE_ULP32K;
+	config_gerador.run_in_standby = true;
+	system_gclk_gen_set_config(GCLK_GENERATOR_2, &config_gerador);
+	system_gclk_gen_enable(GCLK_GENERATOR_2);
+	
+	system_gclk_chan_get_config_defaults(&config_canal);
+	config_canal.source_generator = GCLK_GENERATOR_2;
+	system_gclk_chan_set_config(RTC_GCLK_ID, &config_canal);
+	system_gclk_chan_enable(RTC_GCLK_ID);
+	
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBA, PM_APBAMASK_RTC);
+	
+	RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_SWRST;
+	while(RTC->MODE0.CTRL.reg & RTC_MODE0_CTRL_SWRST);
+	
+	RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_MODE_COUNT32 | RTC_MODE0_CTRL_PRESCALER_DIV1;
+	while(RTC->MODE0.STATUS.reg & RTC_STATUS_SYNCBUSY);
+	
+	RTC->MODE0.INTENSET.reg = RTC_MODE0_INTENSET_CMP0;
+	NVIC_EnableIRQ(RTC_IRQn);
+	
+	RTC->MODE0.CTRL.reg |= RTC_MODE0_CTRL_ENABLE;
+	while(RTC->MODE0.STATUS.reg & RTC_STATUS_SYNCBUSY);
+}
+
+/* le o contador do RTC, que precisa ser sincronizado com o clock da CPU */
+static uint32_t LeContadorDespertador(void)
+{
+	RTC->MODE0.READREQ.reg = RTC_READREQ_RREQ;
+	while(RTC->MODE0.STATUS.reg & RTC_STATUS_SYNCBUSY);
+	return RTC->MODE0.COUNT.reg;
+}
+
+/* fracao de marca de tempo que passou mas ainda nao foi contada, em ciclos do RTC 
+   multiplicados por cfg_MARCA_TEMPO_HZ (uma marca = RTC_FREQ_HZ) */
+static uint32_t resto_marca = 0;
+
+/* Desliga a marca de tempo e dorme por ate qtas_marcas marcas de tempo. E chamada 
+ * pela tarefa ociosa com as interrupcoes bloqueadas: o WFI acorda com qualquer 
+ * interrupcao pendente, mas ela so e atendida depois do REG_ATOMICA_FIM().
+ * O modo de baixo consumo e escolhido pelo tempo ocioso esperado e pela latencia 
+ * de cada modo: o STANDBY economiza mais energia, mas demora mais para acordar, 
+ * entao o despertador e programado para tocar antes, descontando a latencia. 
+ * Retorna o numero de marcas de tempo que passaram enquanto a CPU dormia. A parte da
+ * marca atual que ja tinha passado e a fracao de marca no fim do sono ficam em 
+ * resto_marca para a proxima vez, entao a contagem de marcas nao atrasa a cada sono. */
+tick_t DormeSemMarcaDeTempo(tick_t qtas_marcas)
+{
+	uint32_t inicio, decorrido, ciclos_rtc, latencia, carga, marcas;
+	uint32_t tempo_ocioso_us = (uint32_t)qtas_marcas * (1000000UL / cfg_MARCA_TEMPO_HZ);
+	
+	if(tempo_ocioso_us >= (LATENCIA_STANDBY_US * FATOR_OCIOSO_STANDBY))
+	{
+		system_set_sleepmode(SYSTEM_SLEEPMODE_STANDBY);
+		latencia = LATENCIA_STANDBY_US;
+	}else
+	{
+		system_set_sleepmode(SYSTEM_SLEEPMODE_IDLE_2);
+		latencia = LATENCIA_IDLE_US;
+	}
+	
+	/* converte o tempo ocioso em ciclos do RTC, acordando antes pela latencia do modo */
+	ciclos_rtc = ((uint32_t)qtas_marcas * RTC_FREQ_HZ) / cfg_MARCA_TEMPO_HZ;
+	ciclos_rtc -= (latencia * RTC_FREQ_HZ) / 1000000UL;
+	
+	*(NVIC_SYSTICK_CTRL) &= ~NVIC_SYSTICK_ENABLE;		// Desliga a marca de tempo
+	
+	/* parte da marca atual que ja passou (o SysTick conta para baixo) */
+	carga = *(NVIC_SYSTICK_LOAD);
+	resto_marca += ((carga - *(NVIC_SYSTICK_VAL)) * RTC_FREQ_HZ) / (carga + 1);
+	
+	inicio = LeContadorDespertador();
+	RTC->MODE0.INTFLAG.reg = RTC_MODE0_INTFLAG_CMP0;
+	RTC->MODE0.COMP[0].reg = inicio + ciclos_rtc;
+	while(RTC->MODE0.STATUS.reg & RTC_STATUS_SYNCBUSY);
+	
+	system_sleep();
+	
+	/* acordou pelo despertador ou por outra interrupcao: corrige a contagem de tempo */
+	decorrido = LeContadorDespertador() - inicio;
+	
+	*(NVIC_SYSTICK_VAL) = 0;							// Religa a marca de tempo
+	*(NVIC_SYSTICK_CTRL) |= NVIC_SYSTICK_ENABLE;
+	
+	/* ate 65535 marcas (2,1 milhoes de ciclos do RTC) vezes cfg_MARCA_TEMPO_HZ cabe em 32 bits */
+	resto_marca += decorrido * cfg_MARCA_TEMPO_HZ;
+	marcas = resto_marca / RTC_FREQ_HZ;
+	resto_marca -= marcas * RTC_FREQ_HZ;
+	
+	return (tick_t)marcas;
 }
 
+/* interrupcao do despertador, apenas para acordar a CPU */
+void RTC_Handler(void)
+{
+	RTC->MODE0.INTFLAG.reg = RTC_MODE0_INTFLAG_CMP0;
+}
+#endif
+
 /* rotinas de interrupcao necessarias */
 __attribute__ ((naked)) void SVC_Handler(void)
 {
 	/* Make PendSV and SysTick the lowest priority interrupts. */
 	*(NVIC_SYSPRI3) |= NVIC_PENDSV_PRI;
 	*(NVIC_SYSPRI3) |= NVIC_SYSTICK_PRI;
-	RESTAURA_SP(SP);
+	
+	/* stack pointer da primeira tarefa, passado em R0 (empilhado na entrada da SVC) */
+	__asm volatile(
+		"MRS     R0, MSP            \n"
+		"LDR     R0, [R0]           \n"
+	);
 	RESTAURA_CONTEXTO();
-	RESTAURA_ISR();
 }
 
-__attribute__ ((naked)) void PendSV_Handler(void)
+/* Troca de contexto. O escalonador e chamado antes de salvar o contexto: pelo padrao de
+ * chamada (AAPCS) a funcao em C preserva R4-R11, entao eles so sao salvos e restaurados
+ * quando a tarefa e trocada, e quando a tarefa continua a mesma a PendSV retorna direto.
+ * O stack pointer vai e volta em R0, sem variaveis globais, e a disposicao dos registradores
+ * na pilha e a mesma de CriaContexto: R8-R11 no stack pointer e R4-R7 acima.
+ *
+ * Ciclos do Cortex-M0+ (sem os estados de espera da flash e sem a funcao em C):
+ *                          versao anterior    esta versao
+ *   mesma tarefa                  59              20
+ *   troca de tarefa               59              52
+ * A versao anterior sempre salvava e restaurava R4-R11 (20 + 22 ciclos), passava o SP 
+ * pela variavel global SP (SALVA_SP e RESTAURA_SP, 8 ciclos, e mais uns 12 na funcao em C 
+ * com o ponteiro_de_pilha) e limpava a PendSV pendente (6 ciclos). Os tempos medidos com
+ * a funcao em C ficam no benchmark.c (troca_ida_volta) */
+NA_RAM __attribute__ ((naked)) void PendSV_Handler(void)
 {
-	
-	SALVA_ISR();
-	SALVA_CONTEXTO();
-	SALVA_SP(SP);
-	
-	Clear_PendSV();
-	
-    TrocaContextoDasTarefas();
-	
-	RESTAURA_SP(SP);
-	RESTAURA_CONTEXTO();
-	RESTAURA_ISR();
-	
+	__asm volatile(
+		"CPSID   I                  \n"
+		"MRS     R0, PSP            \n"
+		"SUBS    R0, #32            \n"		/* stack pointer depois de salvar R4-R11 */
+		"PUSH    {R0, LR}           \n"		/* guarda tambem o EXC_RETURN */
+		"BL      TrocaContextoDasTarefas \n"
+		"POP     {R1, R2}           \n"
+		"CMP     R0, #0             \n"
+		"BEQ     1f                 \n"		/* a tarefa atual continua */
+		
+		/* salva R4-R11 da tarefa atual */
+		"ADDS    R1, #16            \n"
+		"STM     R1!, {R4-R7}       \n"
+		"SUBS    R1, #32            \n"
+		"MOV     R4, R8             \n"
+		"MOV     R5, R9             \n"
+		"MOV     R6, R10            \n"
+		"MOV     R7, R11            \n"
+		"STM     R1!, {R4-R7}       \n"
+		
+		/* restaura R4-R11 da nova tarefa */
+		"LDM     R0!, {R4-R7}       \n"
+		"MOV     R8, R4             \n"
+		"MOV     R9, R5             \n"
+		"MOV     R10, R6            \n"
+		"MOV     R11, R7            \n"
+		"LDM     R0!, {R4-R7}       \n"
+		"MSR     PSP, R0            \n"
+		
+	"1:  CPSIE   I                  \n"
+		"BX      R2                 \n"		/* retorno da interrupcao */
+	);
 }
 
 /* Codigo dependente de hardware usado para 
    realizar a marca de tempo do sistema multitarefas - interrupcao */
-void SysTick_Handler(void)
+NA_RAM static void __attribute__((used)) MarcaDeTempo(void)
 {	
 	 
-	 ExecutaMarcaDeTempo();    
-	 //TrocaContexto();   /* para o uso como sistema preemptivo */
+#if cfg_PREEMPTIVO
+	 /* so pendura a PendSV se a tarefa atual deve ser trocada */
+	 if(ExecutaMarcaDeTempo())
+	 {
+		 PEDE_TROCA_CONTEXTO();
+	 }
+#else
+	 ExecutaMarcaDeTempo();
+#endif
+}
+
+#if cfg_PERFIL
+/* Com o perfilador, a interrupcao da marca de tempo primeiro amostra o PC do codigo
+ * interrompido, que o processador empilhou na entrada da interrupcao (7a palavra do 
+ * quadro), na pilha da tarefa (PSP) ou, se interrompeu outra interrupcao, na pilha 
+ * principal (MSP), conforme o bit 2 do EXC_RETURN em LR */
+NA_RAM __attribute__ ((naked)) void SysTick_Handler(void)
+{
+	__asm volatile(
+		"MOVS    R0, #4             \n"
+		"MOV     R1, LR             \n"
+		"TST     R0, R1             \n"
+		"BEQ     1f                 \n"
+		"MRS     R0, PSP            \n"
+		"B       2f                 \n"
+	"1:  MRS     R0, MSP            \n"
+	"2:  LDR     R0, [R0, #24]      \n"		/* PC empilhado */
+		"PUSH    {R4, LR}           \n"		/* guarda o EXC_RETURN, mantendo a pilha alinhada em 8 */
+		"BL      PerfilAmostra      \n"
+		"BL      MarcaDeTempo       \n"
+		"POP     {R4, PC}           \n"		/* retorno da interrupcao */
+	);
+}
+#else
+NA_RAM void SysTick_Handler(void)
+{
+	MarcaDeTempo();
 }
+#endif
 
 void HardFault_Handler(void)
 {
@@ -23,6 +23,7 @@ typedef uint32_t* stackptr_t;
 #define NVIC_SYSPRI3			( ( volatile unsigned long *) 0xe000ed20 )
 #define NVIC_SYSTICK_CTRL       ( ( volatile unsigned long *) 0xe000e010 )
 #define NVIC_SYSTICK_LOAD       ( ( volatile unsigned long *) 0xe000e014 )
+#define NVIC_SYSTICK_VAL        ( ( volatile unsigned long *) 0xe000e018 )
 
 #define NVIC_PENDSVSET      			0x10000000         			// Dispara excecao PendSV
 #define NVIC_PENDSVCLR      			0x08000000         			// Limpa a flag PendSV
@@ -35,41 +36,50 @@ typedef uint32_t* stackptr_t;
 #define NVIC_PENDSV_PRI					( ( ( unsigned long ) KERNEL_INTERRUPT_PRIORITY ) << 16 )
 #define NVIC_SYSTICK_PRI				( ( ( unsigned long ) KERNEL_INTERRUPT_PRIORITY ) << 24 )
 
+/* modo sem marca de tempo: o RTC conta com o oscilador de 32 kHz de ultra baixo consumo,
+   que continua ligado no modo STANDBY */
+#define RTC_FREQ_HZ						32768
+#define LATENCIA_IDLE_US				10			// tempo para acordar do modo IDLE
+#define LATENCIA_STANDBY_US				500			// tempo para acordar do modo STANDBY (religar os osciladores)
+#define FATOR_OCIOSO_STANDBY			4			// o modo STANDBY so e usado se o tempo ocioso for maior que FATOR x latencia
+
+/* medida do tempo de execucao: o TC4 (junto com o TC5) conta em 32 bits com o clock 
+   da CPU dividido por 16, isto e, 3 MHz (resolucao de 333 ns, volta a zero a cada 23 minutos) */
+#define CONTADOR_TEMPO_DIVISOR			16
+#define CONTADOR_TEMPO_HZ				(cfg_CPU_CLOCK_HZ / CONTADOR_TEMPO_DIVISOR)
+
+/* com a leitura continua (RCONT) o COUNT ja esta sincronizado, entao ler e so um acesso a memoria */
+#define LE_CONTADOR_TEMPO()				(TC4->COUNT32.COUNT.reg)
+
+/* funcoes e tabelas executadas da SRAM (cfg_FUNCOES_NA_RAM): o script de ligacao do ASF poe 
+   a secao .ramfunc junto com o .data na SRAM e a partida (Reset_Handler) copia as duas da flash.
+   As chamadas entre a flash e a SRAM ficam fora do alcance do BL e passam por um trampolim 
+   (veneer) criado pelo ligador */
+#define FUNCAO_NA_RAM		__attribute__ ((section(".ramfunc")))
+#define DADOS_NA_RAM		__attribute__ ((section(".data.na_ram")))
 
 /* macros dependentes de hardware, instrucoes em assembly */
 #define REG_ATOMICA_INICIO()  	  __asm(" CPSID I");
 #define REG_ATOMICA_FIM()  		  __asm(" CPSIE I");
 
+/* versoes que guardam e restauram o estado anterior das interrupcoes, para uso em 
+   rotinas de interrupcao ou dentro de outra regiao atomica */
+#define REG_ATOMICA_SALVA(estado)		__asm volatile(" MRS %0, PRIMASK \n CPSID I" : "=r" (estado) :: "memory");
+#define REG_ATOMICA_RESTAURA(estado)	__asm volatile(" MSR PRIMASK, %0" :: "r" (estado) : "memory");
+
+/* diferente de zero quando executando uma rotina de interrupcao (registrador IPSR) */
+#define EM_INTERRUPCAO()		({ uint32_t ipsr; __asm volatile(" MRS %0, IPSR" : "=r" (ipsr)); ipsr; })
+
 #define TROCA_CONTEXTO()		*(NVIC_INT_CTRL_B) = NVIC_PENDSVSET; __asm(" CPSIE I");
 #define TrocaContexto()		    TROCA_CONTEXTO()
+#define PEDE_TROCA_CONTEXTO()	*(NVIC_INT_CTRL_B) = NVIC_PENDSVSET		// apenas pendura a PendSV, para uso em interrupcoes
 #define Clear_PendSV(void)		*(NVIC_INT_CTRL_B) = NVIC_PENDSVCLR
 
-#define GERA_INTERRUPCAO_SW()      __asm(  /* Call SVC to start the first task. */		\
-										"cpsie i				\n"					\
-										"svc 0					\n"					\
-									);												\
-
-
-#define RESTAURA_SP(SP)		__asm(	"LDR	 R1, =SP	    \n"		\
-									"LDR     R0, [R1]		\n"		\
-							);
-
-#define SALVA_SP(SP)		__asm(	"LDR	R1,	=SP	    \n"		\
-									"STR    R0, [R1]	\n"		\
-							);
-
-#define SALVA_CONTEXTO()   __asm(								\
-								"MRS     R0,PSP			\n"		\
-								"SUB     R0, R0, #0x10	\n"		\
-								"STM     R0,{R4-R7}		\n"		\
-								"MOV     R4,R8          \n"		\
-								"MOV     R5,R9          \n"		\
-								"MOV     R6,R10         \n"		\
-								"MOV     R7,R11         \n"		\
-								"SUB     R0, R0, #0x20	\n"		\
-								"STM     R0,{R4-R7}		\n"		\
-								"SUB     R0, R0, #0x10	\n"		\
-							);
+/* inicia a primeira tarefa pela SVC, com o stack pointer dela em R0 */
+#define GERA_INTERRUPCAO_SW(sp)    __asm volatile(	"MOV     R0, %0		\n"				\
+													"CPSIE   I			\n"				\
+													"SVC     0			\n"				\
+													:: "r" (sp) : "r0", "memory");
 
 #define RESTAURA_CONTEXTO()    __asm volatile(											  \
 									/* Restore r4-11 from new process stack */			  \
@@ -88,14 +98,5 @@ typedef uint32_t* stackptr_t;
 									"BX      R1               	\n"						  \
 								)
 
-#define SALVA_ISR()			// em branco para este processador
-
-#define RESTAURA_ISR()		__asm(							  \
-								"LDR     R1,=0xFFFFFFFD     \n"						  \
-								/* Exception return will restore remaining context */ \
-								"CPSIE   I					\n"						  \
-								"BX      R1               	\n"						  \
-							)
-
 
 #endif /* CPU_PORT_H_ */
\ No newline at end of file
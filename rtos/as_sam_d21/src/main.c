@@ -13,8 +13,9 @@
  * Este arquivo contem exemplos diversos de tarefas e 
  * funcionalidades de um sistema operacional multitarefas.
  *
- *
-...
+ */
+
+/*
  * Inclusao de arquivos de cabecalhos
  */
 #include <asf.h>
@@ -34,6 +35,14 @@ void tarefa_7(void);
 void tarefa_8(void);
 void tarefa_9(void);
 void tarefa_10(void);
+void tarefa_16(void);
+void tarefa_17(void);
+void tarefa_18(void);
+void tarefa_19(void);
+void tarefa_20(void);
+void tarefa_21(void);
+void tarefa_22(void);
+void tarefa_27(void);
 
 /*
  * Configuracao dos tamanhos das pilhas
@@ -48,6 +57,15 @@ void tarefa_10(void);
 #define TAM_PILHA_8			(TAM_MINIMO_PILHA + 24)
 #define TAM_PILHA_9			(TAM_MINIMO_PILHA + 24)
 #define TAM_PILHA_10			(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_16			(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_17			(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_18			(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_19			(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_20			(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_21			(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_22			(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_27			(TAM_MINIMO_PILHA + 24)
+#define TAM_PILHA_TEMPORIZADORES	(TAM_MINIMO_PILHA + 24)
 #define TAM_PILHA_OCIOSA	(TAM_MINIMO_PILHA + 24)
 
 /*
@@ -63,8 +81,29 @@ uint32_t PILHA_TAREFA_7[TAM_PILHA_7];
 uint32_t PILHA_TAREFA_8[TAM_PILHA_8];
 uint32_t PILHA_TAREFA_9[TAM_PILHA_9];
 uint32_t PILHA_TAREFA_10[TAM_PILHA_10];
+uint32_t PILHA_TAREFA_16[TAM_PILHA_16];
+uint32_t PILHA_TAREFA_17[TAM_PILHA_17];
+uint32_t PILHA_TAREFA_18[TAM_PILHA_18];
+uint32_t PILHA_TAREFA_19[TAM_PILHA_19];
+uint32_t PILHA_TAREFA_20[TAM_PILHA_20];
+uint32_t PILHA_TAREFA_21[TAM_PILHA_21];
+uint32_t PILHA_TAREFA_22[TAM_PILHA_22];
+uint32_t PILHA_TAREFA_27[TAM_PILHA_27];
+uint32_t PILHA_TEMPORIZADORES[TAM_PILHA_TEMPORIZADORES];
 uint32_t PILHA_TAREFA_OCIOSA[TAM_PILHA_OCIOSA];
 
+/*
+ * Temporizadores de exemplo
+ */
+void incrementa_a(temporizador_t* temporizador);
+void incrementa_b(temporizador_t* temporizador);
+void pisca_led(temporizador_t* temporizador);
+
+TEMPORIZADOR_DECLARA(TemporizadorA, incrementa_a, 0, 3, 1);
+TEMPORIZADOR_DECLARA(TemporizadorB, incrementa_b, 0, 5, 1);
+TEMPORIZADOR_DECLARA(TemporizadorLed, pisca_led, 0, 100, 0);
+
+#ifndef BENCHMARK		/* na configuracao Benchmark o main esta em benchmark.c */
 /*
  * Funcao principal de entrada do sistema
  */
@@ -87,18 +126,40 @@ int main(void)
     CriaTarefa(tarefa_9,"Tarefa 9",PILHA_TAREFA_9,TAM_PILHA_9,3);
     CriaTarefa(tarefa_10,"Tarefa 10",PILHA_TAREFA_10,TAM_PILHA_10,2);
     
+    /* inversao de prioridade evitada pela heranca de prioridade do mutex */
+    //CriaTarefa(tarefa_16,"Tarefa 16",PILHA_TAREFA_16,TAM_PILHA_16,1);
+    //CriaTarefa(tarefa_17,"Tarefa 17",PILHA_TAREFA_17,TAM_PILHA_17,2);
+    //CriaTarefa(tarefa_18,"Tarefa 18",PILHA_TAREFA_18,TAM_PILHA_18,3);
+    
+    /* produtor/consumidor com fila de ponteiros para blocos de dados */
+    //CriaTarefa(tarefa_19,"Tarefa 19",PILHA_TAREFA_19,TAM_PILHA_19,1);
+    //CriaTarefa(tarefa_20,"Tarefa 20",PILHA_TAREFA_20,TAM_PILHA_20,2);
+    
+    /* espera por varios eventos com grupo de eventos */
+    //CriaTarefa(tarefa_21,"Tarefa 21",PILHA_TAREFA_21,TAM_PILHA_21,2);
+    //CriaTarefa(tarefa_22,"Tarefa 22",PILHA_TAREFA_22,TAM_PILHA_22,1);
+    
+    /* acoes periodicas com temporizadores de software, sem uma tarefa para cada uma
+     * (compare com as tarefas 3 e 4) */
+    //CriaTarefa(tarefa_temporizadores,"Temporizadores",PILHA_TEMPORIZADORES,TAM_PILHA_TEMPORIZADORES,3);
+    //TemporizadorInicia(&TemporizadorA);
+    //TemporizadorInicia(&TemporizadorB);
+    //TemporizadorInicia(&TemporizadorLed);
+    
+    /* uso das pilhas de todas as tarefas, para dimensiona-las (cfg_VERIFICA_PILHA = 1) */
+    //CriaTarefa(tarefa_27,"Tarefa 27",PILHA_TAREFA_27,TAM_PILHA_27,1);
+    
 	/* Cria tarefa ociosa do sistema */
 	CriaTarefa(tarefa_ociosa,"Tarefa ociosa", PILHA_TAREFA_OCIOSA, TAM_PILHA_OCIOSA, 0);
 	
-	/* Habilita interrupcoes globais no processador */
-	sei();
-	
-	/* Inicia o escalonador */
-	IniciaRTOS();
+	/* Configura a marca de tempo (SysTick) e inicia o escalonador */
+	ConfiguraMarcaTempo();
+	IniciaMultitarefas();
     
 	/* O codigo nao devera alcancar este ponto */
 	while(1);
 }
+#endif
 
 /* Tarefas de exemplo que usam funcoes para ligar/desligar o LED de acordo com a alternancia entre as tarefas */
 void tarefa_1(void)
@@ -145,6 +206,27 @@ void tarefa_4(void)
 	}
 }
 
+/* Temporizadores de exemplo que fazem o mesmo que as tarefas 3 e 4, mas sem gastar
+ * uma pilha cada: as funcoes sao executadas pela tarefa dos temporizadores. O temporizador
+ * do LED e de uma vez so e mostra que a funcao pode reiniciar o proprio temporizador */
+volatile uint16_t contador_a = 0, contador_b = 0;
+
+void incrementa_a(temporizador_t* temporizador)
+{
+	contador_a++;
+}
+
+void incrementa_b(temporizador_t* temporizador)
+{
+	contador_b++;
+}
+
+void pisca_led(temporizador_t* temporizador)
+{
+	port_pin_toggle_output_level(LED_0_PIN);
+	TemporizadorMudaPeriodo(temporizador, (temporizador->periodo == 100) ? 900 : 100);
+}
+
 /* Tarefas de exemplo que usam funcoes de semaforo */
 
 semaforo_t SemaforoTeste = {0,0}; /* declaracao e inicializacao de um semaforo */
@@ -221,24 +303,14 @@ void tarefa_8(void)
 {
 
 	uint8_t valor, f = 0;			/* inicializacoes para a tarefa */
-	uint8_t contador = 0;	
 	
 	for(;;)
 	{
-		do
+		/* espera por ate 100 marcas: se o produtor parar, a tarefa nao fica travada */
+		if(SemaforoAguardaTempo(&SemaforoCheio, 100) == TEMPO_ESGOTADO)
 		{
-			REG_ATOMICA_INICIO();
-			contador = SemaforoCheio.contador;
-			REG_ATOMICA_FIM();
-			
-			if(!contador)
-			{
-				TarefaEspera(100);
-			}
-				
-		} while (!contador);
-		
-		SemaforoAguarda(&SemaforoCheio);
+			continue;
+		}
 		
 		valor = buffer[f];
 		f = (f+1) % TAM_BUFFER;		
@@ -287,17 +359,159 @@ void tarefa_10(void)
     }
 }
 
-...
-/* Tarefa ociosa do sistema */
-void tarefa_ociosa(void)
+/* Tarefas de exemplo de mutex com heranca de prioridade. A tarefa 16 (baixa prioridade) 
+ * usa o recurso por algum tempo. Enquanto isso a tarefa 18 (alta prioridade) tenta usar o 
+ * mesmo recurso e a tarefa 16 herda a sua prioridade, de forma que a tarefa 17 (prioridade 
+ * intermediaria), que ocupa a CPU, nao consegue atrasar a liberacao do recurso.
+ * O pior tempo de bloqueio da tarefa 18 fica em MutexRecurso.bloqueio_max */
+mutex_t MutexRecurso = {0}; /* declaracao e inicializacao de um mutex */
+
+void tarefa_16(void)
+{
+	volatile uint32_t i;
+	
+	for(;;)
+	{
+		MutexTrava(&MutexRecurso);
+		for(i = 0; i < 10000; i++);		/* usa o recurso compartilhado */
+		MutexLibera(&MutexRecurso);
+		
+		TarefaEspera(5);
+	}
+}
+
+void tarefa_17(void)
+{
+	volatile uint32_t i;
+	
+	for(;;)
+	{
+		TarefaEspera(3);
+		for(i = 0; i < 50000; i++);		/* ocupa a CPU por bastante tempo */
+	}
+}
+
+void tarefa_18(void)
+{
+	for(;;)
+	{
+		TarefaEspera(2);
+		MutexTrava(&MutexRecurso);
+		port_pin_set_output_level(LED_0_PIN, LED_0_ACTIVE);
+		MutexLibera(&MutexRecurso);
+	}
+}
+
+/* Tarefas de produtor/consumidor usando uma fila de ponteiros: o produtor preenche 
+ * blocos de dados e envia apenas o ponteiro do bloco, sem copiar os dados.
+ * A fila de blocos livres devolve os blocos ao produtor. */
+#define NUMERO_BLOCOS		4
+#define TAM_BLOCO			64
+
+uint8_t blocos[NUMERO_BLOCOS][TAM_BLOCO];
+FILA_DE_PONTEIROS_DECLARA(FilaBlocosCheios, NUMERO_BLOCOS);
+FILA_DE_PONTEIROS_DECLARA(FilaBlocosLivres, NUMERO_BLOCOS);
+
+void tarefa_19(void)
 {
+	uint8_t *bloco;
+	uint8_t a = 1, i;
+	
+	for(i = 0; i < NUMERO_BLOCOS; i++)
+	{
+		bloco = blocos[i];
+		FilaEnviaPonteiro(&FilaBlocosLivres, bloco, NAO_ESPERA);
+	}
+	
 	for(;;)
 	{
-		/* As CPUs modernas permitem habilitar o modo de baixo consumo (sleep/idle) apenas com uma instrucao.
-		 * De forma alternativa para outros processadores, estes modos de baixo consumo podem ser habilitados
-		 * com leitura de registradores de sistema/perifericos e instrucoes especificas de configuracao do clock.
-		 * Com isto, caso a CPU tenha alguma tarefa para realizar ela "acorda", realiza a tarefa e em seguida
-		 * volta para o modo de baixo consumo, economizando energia. */
-		 //sleepmgr_enter_sleep();
+		FilaRecebePonteiro(&FilaBlocosLivres, bloco, ESPERA_INFINITA);
+		
+		for(i = 0; i < TAM_BLOCO; i++)
+		{
+			bloco[i] = a++;
+		}
+		
+		FilaEnviaPonteiro(&FilaBlocosCheios, bloco, ESPERA_INFINITA);
+	}
+}
+
+void tarefa_20(void)
+{
+	uint8_t *bloco;
+	
+	for(;;)
+	{
+		if(FilaRecebePonteiro(&FilaBlocosCheios, bloco, 100) == SUCESSO)
+		{
+			/* o consumidor usaria os dados do bloco aqui */
+			FilaEnviaPonteiro(&FilaBlocosLivres, bloco, ESPERA_INFINITA);
+		}
+	}
+}
+
+/* Tarefas de exemplo de grupo de eventos. A tarefa 21 espera por um quadro recebido 
+ * OU pelo botao, com tempo limite, sem precisar verificar periodicamente (polling).
+ * Em uma aplicacao real os eventos seriam ligados nas rotinas de interrupcao da UART 
+ * e do botao, com EventosSinalizaDaISR(). Aqui a tarefa 22 simula estas interrupcoes. */
+#define EVENTO_QUADRO		(1ul << 0)
+#define EVENTO_BOTAO		(1ul << 1)
+
+grupo_eventos_t EventosEntrada = {0,0}; /* declaracao e inicializacao de um grupo de eventos */
+
+void tarefa_21(void)
+{
+	uint32_t eventos;
+	
+	for(;;)
+	{
+		if(EventosAguarda(&EventosEntrada, EVENTO_QUADRO | EVENTO_BOTAO, 
+			EVENTOS_QUALQUER | EVENTOS_LIMPA, &eventos, 100) == TEMPO_ESGOTADO)
+		{
+			port_pin_set_output_level(LED_0_PIN, !LED_0_ACTIVE);	/* nada aconteceu em 100 marcas */
+			continue;
+		}
+		
+		if(eventos & EVENTO_QUADRO)
+		{
+			port_pin_set_output_level(LED_0_PIN, LED_0_ACTIVE);		/* trata o quadro recebido */
+		}
+		
+		if(eventos & EVENTO_BOTAO)
+		{
+			port_pin_toggle_output_level(LED_0_PIN);				/* trata o botao */
+		}
+	}
+}
+
+void tarefa_22(void)
+{
+	for(;;)
+	{
+		TarefaEspera(30);
+		EventosSinaliza(&EventosEntrada, EVENTO_QUADRO);
+		TarefaEspera(150);
+		EventosSinaliza(&EventosEntrada, EVENTO_BOTAO);
+	}
+}
+
+/* Tarefa que mostra quanto da pilha de cada tarefa nunca foi usado. Depois de 
+ * executar todas as tarefas nos seus piores casos, o tamanho de cada pilha pode ser
+ * reduzido para o usado mais uma margem, no lugar de TAM_MINIMO_PILHA + 24 para todas.
+ * Observar o vetor pilha_livre[] no depurador (em palavras de 32 bits). */
+volatile uint16_t pilha_livre[NUMERO_DE_TAREFAS+1];
+
+void tarefa_27(void)
+{
+	uint16_t i;
+	
+	for(;;)
+	{
+		for(i = 1; i <= NUMERO_DE_TAREFAS; i++)
+		{
+			pilha_livre[i] = TarefaPilhaLivre(i);
+		}
+		
+		TarefaEspera(1000);
 	}
 }
@@ -8,210 +8,2073 @@
 /* variaveis do sistema multitarefas */
 uint8_t 	   tarefa_atual, proxima_tarefa;
 tcb_t   	   TCB[NUMERO_DE_TAREFAS+1];
-stackptr_t	   ponteiro_de_pilha;
-prioridade_t   Prioridades[PRIORIDADE_MAXIMA+1];   /* vetor com as prioridades das tarefas */
-uint32_t	   SP;
+tarefas_t	   Tarefas;		/* campos usados pelo escalonador, um vetor por campo */
+uint8_t        Prioridades[PRIORIDADE_MAXIMA+1];   /* vetor com a primeira tarefa pronta de cada prioridade */
+
+/* contadores de trocas de contexto feitas e evitadas pelos servicos do sistema */
+uint32_t	   contador_trocas = 0;
+uint32_t	   contador_trocas_evitadas = 0;
 
 /* variavel auxiliar para guardar o numero de marcas de tempo */
 static tick_t contador_marcas = 0;
 
+#if cfg_LATENCIA && !cfg_TEMPO_DE_EXECUCAO
+/* numero de marcas de tempo em 32 bits, para o instante da medida da latencia: com o
+   contador_marcas de 16 bits o instante voltaria a zero antes de 2^32 ciclos */
+static uint32_t marcas_latencia = 0;
+#endif
+
+#if cfg_PREEMPTIVO && cfg_FATIA_TEMPO > 0
+/* marcas de tempo que faltam para terminar a fatia de tempo da tarefa atual */
+static tick_t fatia_restante = cfg_FATIA_TEMPO;
+#endif
+
 static uint8_t numero_tarefas = 0;
 
-/* codigo independente de hardware */
-/* funcao para realizar o escalonamento de tarefas por prioridades 
-   que retorna a proxima tarefa que sera executada, isto e, aquela que
-   tem a maior prioridade e que esta pronta para executar */
-   
-uint8_t escalonador(void)
-{
-    
-	uint8_t prioridade;
-	uint8_t tarefa_selecionada = 0;
-    
-	/* comeca pela maior prioridade ate encontrar 
-	uma tarefa em estado de pronta para executar  */	
-    for (prioridade=PRIORIDADE_MAXIMA;prioridade>0;prioridade--)
-	{ 
-      if(Prioridades[prioridade] != 0)
-	  {        
-        tarefa_selecionada = Prioridades[prioridade];
-        if(TCB[tarefa_selecionada].estado == PRONTA)
-		{    
-		 /* retorna aquela que tem a maior prioridade e que esta pronta para executar */		
-          return tarefa_selecionada;    
-        }
-      }
-    } 
-    
-	/* caso nenhuma esteja pronta para executar, retorna a de menor prioridade, 
-	 a qual sempre deve estar pronta para executar */
-    if(prioridade == 0) 
-	{
-    	tarefa_selecionada = Prioridades[prioridade];
-    }
-	
-	return tarefa_selecionada;
+/* numero de tarefas que se excluiram e esperam a tarefa ociosa liberar a pilha */
+static uint8_t tarefas_excluidas = 0;
+
+#if cfg_TEMPO_DE_EXECUCAO
+/* leitura do contador de tempo na ultima troca de contexto */
+static uint32_t inicio_execucao = 0;
+
+/* tarefa ociosa, tempo ocioso no inicio da janela da carga da CPU, marcas que faltam
+   para fechar a janela e carga da CPU da ultima janela, em milesimos */
+static uint8_t tarefa_da_ociosa = 0;
+static uint32_t ocioso_inicio_janela = 0, inicio_janela = 0;
+static tick_t janela_restante = cfg_JANELA_CARGA;
+static uint16_t carga_cpu = 0;
+#endif
+
+#if cfg_RASTRO
+rastro_t Rastro = {RASTRO_ASSINATURA, 
+#if cfg_TEMPO_DE_EXECUCAO
+	CONTADOR_TEMPO_HZ, 0,
+#else
+	cfg_CPU_CLOCK_HZ, cfg_CPU_CLOCK_HZ / cfg_MARCA_TEMPO_HZ,
+#endif
+	cfg_RASTRO_TAMANHO, 0, 0, {{0}}};
+
+/* grava um registro no rastro. Pode ser chamada de qualquer lugar, inclusive da PendSV */
+static inline void rastro_grava(uint8_t evento, uint8_t tarefa, uint16_t dado)
+{
+	registro_rastro_t *registro;
+	uint32_t estado;
+	
+	REG_ATOMICA_SALVA(estado);
+	registro = &Rastro.registros[Rastro.indice];
+	Rastro.indice = (Rastro.indice + 1) & (cfg_RASTRO_TAMANHO - 1);
+	Rastro.gravados++;
+#if cfg_TEMPO_DE_EXECUCAO
+	registro->tempo = LE_CONTADOR_TEMPO();
+#else
+	registro->tempo = ((uint32_t)contador_marcas << 16) | 
+		(uint16_t)(*(NVIC_SYSTICK_LOAD) - *(NVIC_SYSTICK_VAL));
+#endif
+	registro->evento = evento;
+	registro->tarefa = tarefa;
+	registro->dado = dado;
+	REG_ATOMICA_RESTAURA(estado);
+}
+
+#define RASTRO(evento, tarefa, dado)	rastro_grava((evento), (tarefa), (uint16_t)(dado))
+#else
+#define RASTRO(evento, tarefa, dado)
+#endif
+
+/* primeira tarefa da lista de tarefas esperando tempo (lista de atrasos).
+   A lista e ordenada pelo instante de acordar e o campo tempo_espera de cada TCB 
+   guarda apenas a diferenca em relacao a tarefa anterior da lista (lista delta), 
+   assim a marca de tempo so precisa decrementar a primeira tarefa da lista */
+static uint8_t lista_atrasos = 0;
+
+static void espera_remove(uint8_t id_tarefa);
+static void heranca_propaga(mutex_t *mutex);
+static void temporizadores_verifica(tick_t marcas);
+#if cfg_MODO_SEM_MARCA
+static tick_t temporizadores_proximo(void);
+#endif
+
+/* mapa de bits das prioridades que tem tarefa pronta para executar:
+   cada bit de mapa_prontas[] representa uma prioridade e cada bit de 
+   grupo_prontas indica se o byte correspondente de mapa_prontas[] tem algum bit ligado */
+static uint8_t  mapa_prontas[NUMERO_GRUPOS_PRIORIDADE];
+#if NUMERO_GRUPOS_PRIORIDADE > 1
+static uint32_t grupo_prontas;
+#endif
+
+/* tabela com a posicao do bit mais significativo de cada valor de 8 bits,
+   pois o Cortex-M0+ nao tem a instrucao CLZ (count leading zeros) */
+static const uint8_t bit_mais_alto[256] TABELA_NA_RAM =
+{
+	0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+	5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
+};
+
+/* codigo independente de hardware */
+
+/* liga o bit da prioridade no mapa de prontas */
+static void prontas_insere(prioridade_t prioridade)
+{
+	mapa_prontas[prioridade >> 3] |= (uint8_t)(1u << (prioridade & 7));
+#if NUMERO_GRUPOS_PRIORIDADE > 1
+	grupo_prontas |= (1ul << (prioridade >> 3));
+#endif
+}
+
+/* desliga o bit da prioridade no mapa de prontas */
+static void prontas_remove(prioridade_t prioridade)
+{
+	mapa_prontas[prioridade >> 3] &= (uint8_t)~(1u << (prioridade & 7));
+#if NUMERO_GRUPOS_PRIORIDADE > 1
+	if(mapa_prontas[prioridade >> 3] == 0)
+	{
+		grupo_prontas &= ~(1ul << (prioridade >> 3));
+	}
+#endif
+}
+
+/* retorna a maior prioridade com tarefa pronta em tempo constante,
+   usando no maximo duas consultas a tabela bit_mais_alto[] */
+NA_RAM static prioridade_t prontas_maior_prioridade(void)
+{
+#if NUMERO_GRUPOS_PRIORIDADE > 1
+	uint8_t grupo;
+	
+	if(grupo_prontas >> 16)
+	{
+		grupo = (grupo_prontas >> 24) ? (uint8_t)(24 + bit_mais_alto[grupo_prontas >> 24]) :
+										(uint8_t)(16 + bit_mais_alto[(grupo_prontas >> 16) & 0xFF]);
+	}else
+	{
+		grupo = (grupo_prontas >> 8) ? (uint8_t)(8 + bit_mais_alto[(grupo_prontas >> 8) & 0xFF]) :
+									   bit_mais_alto[grupo_prontas & 0xFF];
+	}
+	return (prioridade_t)((grupo << 3) + bit_mais_alto[mapa_prontas[grupo]]);
+#else
+	return bit_mais_alto[mapa_prontas[0]];
+#endif
+}
+
+/* coloca a tarefa no fim da lista de prontas da sua prioridade (ordem FIFO).
+   As listas sao circulares e duplamente encadeadas pelos campos proxima/anterior 
+   de Tarefas, e Prioridades[] guarda a primeira tarefa pronta de cada prioridade */
+NA_RAM static void tarefa_pronta(uint8_t id_tarefa)
+{
+	prioridade_t prioridade = Tarefas.prioridade[id_tarefa];
+	uint8_t primeira = Prioridades[prioridade];
+	
+	if(Tarefas.estado[id_tarefa] == PRONTA)
+	{
+		return; /* ja esta na lista de prontas */
+	}
+	Tarefas.estado[id_tarefa] = PRONTA;
+	
+	if(primeira == 0)
+	{
+		Tarefas.proxima[id_tarefa] = id_tarefa;
+		Tarefas.anterior[id_tarefa] = id_tarefa;
+		Prioridades[prioridade] = id_tarefa;
+		prontas_insere(prioridade);
+	}else
+	{
+		uint8_t ultima = Tarefas.anterior[primeira];
+		Tarefas.proxima[id_tarefa] = primeira;
+		Tarefas.anterior[id_tarefa] = ultima;
+		Tarefas.proxima[ultima] = id_tarefa;
+		Tarefas.anterior[primeira] = id_tarefa;
+	}
+}
+
+/* coloca a tarefa em estado de espera e a retira da lista de prontas */
+NA_RAM static void tarefa_bloqueia(uint8_t id_tarefa)
+{
+	prioridade_t prioridade = Tarefas.prioridade[id_tarefa];
+	
+	if(Tarefas.estado[id_tarefa] != PRONTA)
+	{
+		return; /* ja esta fora da lista de prontas */
+	}
+	Tarefas.estado[id_tarefa] = ESPERA;
+	
+	if(Tarefas.proxima[id_tarefa] == id_tarefa)
+	{
+		/* era a unica tarefa pronta desta prioridade */
+		Prioridades[prioridade] = 0;
+		prontas_remove(prioridade);
+	}else
+	{
+		Tarefas.proxima[Tarefas.anterior[id_tarefa]] = Tarefas.proxima[id_tarefa];
+		Tarefas.anterior[Tarefas.proxima[id_tarefa]] = Tarefas.anterior[id_tarefa];
+		if(Prioridades[prioridade] == id_tarefa)
+		{
+			Prioridades[prioridade] = Tarefas.proxima[id_tarefa];
+		}
+	}
+}
+
+/* coloca a tarefa atual na lista de atrasos, na posicao correspondente 
+   ao instante em que deve acordar. O tempo de insercao depende do numero de 
+   tarefas esperando, mas e executado pela propria tarefa e nao na marca de tempo */
+NA_RAM static void atraso_insere(uint8_t id_tarefa, tick_t qtas_marcas)
+{
+	uint8_t anterior = 0;
+	uint8_t tarefa = lista_atrasos;
+	
+	/* percorre a lista descontando os tempos das tarefas que acordam antes */
+	while(tarefa != 0 && Tarefas.tempo_espera[tarefa] <= qtas_marcas)
+	{
+		qtas_marcas -= Tarefas.tempo_espera[tarefa];
+		anterior = tarefa;
+		tarefa = Tarefas.proxima_espera[tarefa];
+	}
+	
+	Tarefas.tempo_espera[id_tarefa] = qtas_marcas;
+	Tarefas.anterior_espera[id_tarefa] = anterior;
+	Tarefas.proxima_espera[id_tarefa] = tarefa;
+	
+	if(tarefa != 0)
+	{
+		/* a tarefa seguinte passa a contar a partir desta */
+		Tarefas.tempo_espera[tarefa] -= qtas_marcas;
+		Tarefas.anterior_espera[tarefa] = id_tarefa;
+	}
+	
+	if(anterior != 0)
+	{
+		Tarefas.proxima_espera[anterior] = id_tarefa;
+	}else
+	{
+		lista_atrasos = id_tarefa;
+	}
+}
+
+/* retira a tarefa da lista de atrasos antes do tempo, se ela estiver na lista. Uma
+   tarefa fora da lista tem anterior_espera = 0 e nao e a primeira da lista */
+NA_RAM static void atraso_remove(uint8_t id_tarefa)
+{
+	uint8_t anterior = Tarefas.anterior_espera[id_tarefa];
+	uint8_t proxima = Tarefas.proxima_espera[id_tarefa];
+	
+	if(anterior == 0 && lista_atrasos != id_tarefa)
+	{
+		return; /* nao esta na lista */
+	}
+	
+	if(proxima != 0)
+	{
+		/* o tempo restante passa para a tarefa seguinte */
+		Tarefas.tempo_espera[proxima] += Tarefas.tempo_espera[id_tarefa];
+		Tarefas.anterior_espera[proxima] = anterior;
+	}
+	
+	if(anterior != 0)
+	{
+		Tarefas.proxima_espera[anterior] = proxima;
+	}else
+	{
+		lista_atrasos = proxima;
+	}
+	
+	Tarefas.tempo_espera[id_tarefa] = 0;
+	Tarefas.anterior_espera[id_tarefa] = 0;
+	Tarefas.proxima_espera[id_tarefa] = 0;
+}
+
+/* avanca o contador de marcas de tempo e a lista de atrasos. So a primeira 
+   tarefa da lista e decrementada, pois as demais contam a partir dela. Todas as
+   tarefas que acordam estao no inicio da lista e sao colocadas na fila de prontas
+   de uma vez. Normalmente avanca uma marca, mas no modo sem marca de tempo avanca
+   todas as marcas em que a CPU esteve dormindo */
+NA_RAM static void marcas_avanca(tick_t marcas)
+{
+	uint8_t tarefa = lista_atrasos;
+	
+	contador_marcas += marcas; /* incrementa contador de marcas de tempo */
+#if cfg_LATENCIA && !cfg_TEMPO_DE_EXECUCAO
+	marcas_latencia += marcas;
+#endif
+	
+	while(tarefa != 0 && Tarefas.tempo_espera[tarefa] <= marcas)
+	{
+		marcas -= Tarefas.tempo_espera[tarefa];
+		Tarefas.tempo_espera[tarefa] = 0;
+		
+		lista_atrasos = Tarefas.proxima_espera[tarefa];
+		Tarefas.proxima_espera[tarefa] = 0;
+		Tarefas.anterior_espera[tarefa] = 0;	/* fora da lista (ver atraso_remove) */
+		
+		/* se tambem esperava um objeto, o tempo limite terminou antes */
+		espera_remove(tarefa);
+		
+		/* coloca a tarefa na fila de prontas para executar */
+		tarefa_pronta(tarefa);
+		
+		tarefa = lista_atrasos;
+	}
+	
+	if(tarefa != 0)
+	{
+		Tarefas.tempo_espera[tarefa] -= marcas; /* decrementa tempo de espera */
+		Tarefas.anterior_espera[tarefa] = 0;	/* nova primeira tarefa da lista */
+	}
+}
+
+/* coloca a tarefa, que ja saiu da lista de prontas, na lista de espera de um objeto.
+   A lista e circular, ordenada por prioridade (maior primeiro) e em ordem FIFO dentro 
+   da mesma prioridade, entao a liberacao do objeto so precisa retirar a primeira tarefa */
+NA_RAM static void espera_insere(lista_espera_t *lista, uint8_t id_tarefa)
+{
+	uint8_t primeira = *lista;
+	uint8_t tarefa = primeira;
+	
+	TCB[id_tarefa].espera_em = lista;
+	
+	if(primeira == 0)
+	{
+		Tarefas.proxima[id_tarefa] = id_tarefa;
+		Tarefas.anterior[id_tarefa] = id_tarefa;
+		*lista = id_tarefa;
+		return;
+	}
+	
+	/* procura a primeira tarefa de menor prioridade */
+	do
+	{
+		if(Tarefas.prioridade[tarefa] < Tarefas.prioridade[id_tarefa])
+		{
+			break;
+		}
+		tarefa = Tarefas.proxima[tarefa];
+	}while(tarefa != primeira);
+	
+	/* insere antes dela (ou no fim da lista, se deu a volta) */
+	Tarefas.proxima[id_tarefa] = tarefa;
+	Tarefas.anterior[id_tarefa] = Tarefas.anterior[tarefa];
+	Tarefas.proxima[Tarefas.anterior[tarefa]] = id_tarefa;
+	Tarefas.anterior[tarefa] = id_tarefa;
+	
+	if(tarefa == primeira && Tarefas.prioridade[primeira] < Tarefas.prioridade[id_tarefa])
+	{
+		*lista = id_tarefa;		/* passou a ser a de maior prioridade */
+	}
+}
+
+/* retira a tarefa da lista de espera em que ela estiver */
+NA_RAM static void espera_remove(uint8_t id_tarefa)
+{
+	lista_espera_t *lista = TCB[id_tarefa].espera_em;
+	
+	if(lista == 0)
+	{
+		return;
+	}
+	
+	if(Tarefas.proxima[id_tarefa] == id_tarefa)
+	{
+		*lista = 0;
+	}else
+	{
+		Tarefas.proxima[Tarefas.anterior[id_tarefa]] = Tarefas.proxima[id_tarefa];
+		Tarefas.anterior[Tarefas.proxima[id_tarefa]] = Tarefas.anterior[id_tarefa];
+		if(*lista == id_tarefa)
+		{
+			*lista = Tarefas.proxima[id_tarefa];
+		}
+	}
+	TCB[id_tarefa].espera_em = 0;
+}
+
+/* retira a tarefa de maior prioridade da lista de espera em tempo constante,
+   retorna 0 se a lista esta vazia */
+static uint8_t espera_retira(lista_espera_t *lista)
+{
+	uint8_t tarefa = *lista;
+	
+	if(tarefa != 0)
+	{
+		espera_remove(tarefa);
+	}
+	return tarefa;
+}
+
+#if cfg_LATENCIA
+/* Medida da latencia para acordar tarefas */
+
+#define LATENCIA_LIBERA		0x01
+#define LATENCIA_ISR		0x02
+
+latencia_t Latencia = {LATENCIA_ASSINATURA, 
+#if cfg_TEMPO_DE_EXECUCAO
+	CONTADOR_TEMPO_HZ,
+#else
+	cfg_CPU_CLOCK_HZ,
+#endif
+	LATENCIA_CAMINHOS, LATENCIA_FAIXAS, 0, {{0}}, {{0}}, {0}, {0}};
+
+/* inicio e numero (IPSR) da ultima interrupcao marcada com LATENCIA_ISR_INICIO */
+static uint32_t latencia_inicio_isr;
+static uint32_t latencia_isr_marcada = 0;
+
+/* instante atual: o contador de tempo, se houver, ou os ciclos do SysTick somados as 
+   marcas de tempo, modulo 2^32 (neste caso a leitura pode errar uma marca se o SysTick recarregar 
+   com a marca de tempo ainda pendente) */
+static uint32_t latencia_agora(void)
+{
+#if cfg_TEMPO_DE_EXECUCAO
+	return LE_CONTADOR_TEMPO();
+#else
+	uint32_t carga = *(NVIC_SYSTICK_LOAD);
+	return marcas_latencia * (carga + 1) + (carga - *(NVIC_SYSTICK_VAL));
+#endif
+}
+
+/* faixa do histograma: posicao do bit mais alto, com a mesma tabela do escalonador */
+static uint8_t latencia_faixa(uint32_t latencia)
+{
+	uint8_t faixa;
+	
+	if(latencia >> 24)
+	{
+		faixa = 24 + bit_mais_alto[latencia >> 24];
+	}else if(latencia >> 16)
+	{
+		faixa = 16 + bit_mais_alto[latencia >> 16];
+	}else if(latencia >> 8)
+	{
+		faixa = 8 + bit_mais_alto[latencia >> 8];
+	}else
+	{
+		faixa = bit_mais_alto[latencia];
+	}
+	return (faixa < LATENCIA_FAIXAS) ? faixa : (LATENCIA_FAIXAS - 1);
+}
+
+/* guarda o instante em que a tarefa foi acordada e, se foi pela interrupcao que 
+   acabou de ser marcada, o inicio dela. Deve ser chamada com as interrupcoes bloqueadas */
+static void latencia_acorda(uint8_t id_tarefa)
+{
+	TCB[id_tarefa].latencia_libera = latencia_agora();
+	TCB[id_tarefa].latencia_marcas = LATENCIA_LIBERA;
+	
+	if(EM_INTERRUPCAO() != 0 && EM_INTERRUPCAO() == latencia_isr_marcada)
+	{
+		TCB[id_tarefa].latencia_isr = latencia_inicio_isr;
+		TCB[id_tarefa].latencia_marcas |= LATENCIA_ISR;
+	}
+}
+
+/* chamada pela tarefa logo que volta a executar depois de esperar no caminho */
+static void latencia_retoma(uint8_t caminho)
+{
+	uint32_t agora = latencia_agora();
+	uint32_t latencia, estado;
+	
+	REG_ATOMICA_SALVA(estado);
+	
+	if(TCB[tarefa_atual].latencia_marcas & LATENCIA_LIBERA)
+	{
+		latencia = agora - TCB[tarefa_atual].latencia_libera;
+		Latencia.libera_tarefa[caminho][latencia_faixa(latencia)]++;
+		if(latencia > Latencia.libera_tarefa_max[caminho])
+		{
+			Latencia.libera_tarefa_max[caminho] = latencia;
+		}
+	}
+	
+	if(TCB[tarefa_atual].latencia_marcas & LATENCIA_ISR)
+	{
+		latencia = agora - TCB[tarefa_atual].latencia_isr;
+		Latencia.isr_tarefa[caminho][latencia_faixa(latencia)]++;
+		if(latencia > Latencia.isr_tarefa_max[caminho])
+		{
+			Latencia.isr_tarefa_max[caminho] = latencia;
+		}
+	}
+	
+	TCB[tarefa_atual].latencia_marcas = 0;
+	
+	REG_ATOMICA_RESTAURA(estado);
+}
+
+/* Marca o inicio de uma interrupcao que pode acordar tarefas: deve ser a primeira 
+ * coisa feita pela rotina de interrupcao (LATENCIA_ISR_INICIO) */
+void LatenciaMarcaISR(void)
+{
+	latencia_inicio_isr = latencia_agora();
+	latencia_isr_marcada = EM_INTERRUPCAO();
+}
+
+/* Zera os histogramas para comecar uma nova medida */
+void LatenciaZera(void)
+{
+	uint8_t caminho, faixa;
+	uint32_t estado;
+	
+	REG_ATOMICA_SALVA(estado);
+	for(caminho = 0; caminho < LATENCIA_CAMINHOS; caminho++)
+	{
+		for(faixa = 0; faixa < LATENCIA_FAIXAS; faixa++)
+		{
+			Latencia.isr_tarefa[caminho][faixa] = 0;
+			Latencia.libera_tarefa[caminho][faixa] = 0;
+		}
+		Latencia.isr_tarefa_max[caminho] = 0;
+		Latencia.libera_tarefa_max[caminho] = 0;
+	}
+	REG_ATOMICA_RESTAURA(estado);
+}
+
+#define LATENCIA_ACORDA(id_tarefa)		latencia_acorda(id_tarefa)
+#define LATENCIA_RETOMA(caminho)		latencia_retoma(caminho)
+#else
+#define LATENCIA_ACORDA(id_tarefa)
+#define LATENCIA_RETOMA(caminho)		(void)(caminho)
+#endif
+
+/* bloqueia a tarefa atual na lista de espera de um objeto e, se o tempo limite nao
+   for infinito, tambem na lista de atrasos. Deve ser chamada com as interrupcoes 
+   bloqueadas e so retorna quando a tarefa voltar a executar: o resultado da espera 
+   fica em TCB[tarefa_atual].resultado. O caminho identifica o servico na medida da latencia */
+NA_RAM static void espera_bloqueia(lista_espera_t *lista, tick_t tempo_limite, uint8_t caminho)
+{
+	TCB[tarefa_atual].resultado = TEMPO_ESGOTADO;
+	tarefa_bloqueia(tarefa_atual);				/* tarefa colocada na fila de espera */
+	espera_insere(lista, tarefa_atual);			/* tarefa colocada na espera do objeto, por prioridade */
+	if(tempo_limite != ESPERA_INFINITA)
+	{
+		atraso_insere(tarefa_atual, tempo_limite);
+	}
+	TROCA_CONTEXTO();							/* solicita troca de contexto */
+	LATENCIA_RETOMA(caminho);					/* a tarefa voltou a executar */
+}
+
+/* acorda uma tarefa que esperava um objeto, cancelando o seu tempo limite */
+NA_RAM static void tarefa_acorda(uint8_t id_tarefa)
+{
+	espera_remove(id_tarefa);
+	atraso_remove(id_tarefa);
+	TCB[id_tarefa].resultado = SUCESSO;
+	tarefa_pronta(id_tarefa);
+	LATENCIA_ACORDA(id_tarefa);
+}
+
+/* acorda a tarefa de maior prioridade esperando na lista, cancelando o seu tempo limite.
+   Retorna a tarefa acordada ou 0 se nao havia tarefa esperando */
+NA_RAM static uint8_t espera_acorda(lista_espera_t *lista)
+{
+	uint8_t tarefa = *lista;
+	
+	if(tarefa != 0)
+	{
+		tarefa_acorda(tarefa);
+	}
+	return tarefa;
+}
+
+/* retorna 1 se ha uma tarefa pronta de maior prioridade que a atual (tempo constante) */
+static uint8_t tarefa_mais_prioritaria_pronta(void)
+{
+	return (prontas_maior_prioridade() > Tarefas.prioridade[tarefa_atual]);
+}
+
+/* solicita a troca de contexto apenas se ficou pronta uma tarefa de maior 
+   prioridade que a atual, caso contrario a tarefa atual continua executando
+   sem passar pela PendSV. Deve ser chamada com as interrupcoes bloqueadas */
+NA_RAM static void troca_se_necessario(void)
+{
+	if(tarefa_mais_prioritaria_pronta())
+	{
+		TROCA_CONTEXTO();
+	}else
+	{
+		contador_trocas_evitadas++;
+	}
+}
+
+/* funcao para realizar o escalonamento de tarefas por prioridades 
+   que retorna a proxima tarefa que sera executada, isto e, aquela que
+   tem a maior prioridade e que esta pronta para executar.
+   A busca e feita no mapa de bits das prioridades prontas, por isso
+   o tempo de execucao nao depende do numero de prioridades */
+   
+NA_RAM uint8_t escalonador(void)
+{
+	/* caso nenhuma esteja pronta para executar, o mapa esta vazio e 
+	 retorna a de menor prioridade (0), a qual sempre deve estar pronta para executar */
+	return Prioridades[prontas_maior_prioridade()];
+}
+ 
+
+
+/*********************************************/
+#if cfg_VERIFICA_PILHA
+/* preenche a pilha com o padrao */
+static void pilha_preenche(stackptr_t pilha, uint16_t tamanho)
+{
+	while(tamanho-- > 0)
+	{
+		*pilha++ = PADRAO_PILHA;
+	}
+}
+
+/* conta as palavras do fim da pilha que ainda tem o padrao, isto e, que nunca
+   foram usadas, e atualiza a menor quantidade medida da tarefa */
+static uint16_t pilha_mede(uint8_t id_tarefa)
+{
+	stackptr_t pilha;
+	uint16_t tamanho, livres = 0;
+	
+	REG_ATOMICA_INICIO();
+	pilha = TCB[id_tarefa].pilha;
+	tamanho = TCB[id_tarefa].tam_pilha;
+	REG_ATOMICA_FIM();
+	
+	/* a pilha cresce para baixo: a parte nunca usada fica no inicio do vetor */
+	while(livres < tamanho && pilha[livres] == PADRAO_PILHA)
+	{
+		livres++;
+	}
+	
+	REG_ATOMICA_INICIO();
+	if(pilha == TCB[id_tarefa].pilha && livres < TCB[id_tarefa].pilha_livre)
+	{
+		TCB[id_tarefa].pilha_livre = livres;
+	}
+	livres = TCB[id_tarefa].pilha_livre;
+	REG_ATOMICA_FIM();
+	
+	return livres;
+}
+
+/* Funcao chamada pela troca de contexto quando a pilha de uma tarefa estourou. Pode ser
+ * redefinida pela aplicacao, que nao deve retornar, pois a memoria vizinha ja foi corrompida */
+__attribute__((weak)) void TarefaEstouroPilha(uint8_t id_tarefa)
+{
+	REG_ATOMICA_INICIO();
+	for(;;);		/* para aqui para o depurador mostrar a tarefa em TCB[id_tarefa] */
+}
+#endif
+
+/* Retorna o menor numero de palavras de 32 bits da pilha da tarefa que ainda nao 
+ * foram usadas desde a sua criacao (0 = a pilha foi usada toda ou estourou). 
+ * Necessita de cfg_VERIFICA_PILHA, caso contrario retorna 0 */
+uint16_t TarefaPilhaLivre(uint8_t id_tarefa)
+{
+#if cfg_VERIFICA_PILHA
+	if(id_tarefa != 0 && id_tarefa <= numero_tarefas && Tarefas.estado[id_tarefa] != LIVRE)
+	{
+		return pilha_mede(id_tarefa);
+	}
+#endif
+	return 0;
+}
+
+/* instala a tarefa no primeiro TCB livre, reaproveitando os TCBs de tarefas excluidas.
+   Retorna o identificador da tarefa ou 0 se nao ha TCB livre */
+static uint8_t tarefa_cria(tarefa_t p, const char * nome, stackptr_t pilha, uint16_t tamanho, 
+	prioridade_t prioridade, memoria_t* memoria_pilha)
+{
+	uint16_t id_tarefa;		/* 16 bits: com 255 tarefas o laco vai ate 256 */
+	uint32_t estado;
+	stackptr_t stack_pointer;
+	
+	/* a pilha ainda nao pertence a nenhuma tarefa: e preparada com as interrupcoes habilitadas */
+#if cfg_VERIFICA_PILHA
+	/* preenche a pilha para detectar estouro e medir o quanto foi usado */
+	pilha_preenche(pilha, tamanho);
+#endif
+	stack_pointer = CriaContexto(p, pilha + tamanho);
+	
+	/* so a escolha do TCB e o encadeamento nas listas sao feitos com interrupcoes bloqueadas */
+	REG_ATOMICA_SALVA(estado);
+	
+	for(id_tarefa = 1; id_tarefa <= numero_tarefas; id_tarefa++)
+	{
+		if(Tarefas.estado[id_tarefa] == LIVRE)
+		{
+			break;
+		}
+	}
+	
+	if(id_tarefa > numero_tarefas)
+	{
+		if(numero_tarefas >= NUMERO_DE_TAREFAS)
+		{
+			REG_ATOMICA_RESTAURA(estado);
+			return 0;
+		}
+		/* incrementa o numero de tarefas instaladas */
+		numero_tarefas++;
+	}
+	
+	/* guardar os dados no bloco de controle da tarefa (TCB) */
+	TCB[id_tarefa].nome = nome;
+	TCB[id_tarefa].stack_pointer = stack_pointer;
+	TCB[id_tarefa].pilha = pilha;
+	TCB[id_tarefa].tam_pilha = tamanho;
+	TCB[id_tarefa].pilha_livre = tamanho;
+	TCB[id_tarefa].tempo_execucao = 0;
+	TCB[id_tarefa].memoria_pilha = memoria_pilha;
+	Tarefas.estado[id_tarefa] = ESPERA;
+	Tarefas.prioridade[id_tarefa] = prioridade;
+	TCB[id_tarefa].prioridade_base = prioridade;
+	TCB[id_tarefa].mutexes = 0;
+	TCB[id_tarefa].mutex_esperado = 0;
+	TCB[id_tarefa].mensagem = 0;
+	TCB[id_tarefa].resultado = SUCESSO;
+	TCB[id_tarefa].notificacao = 0;
+	TCB[id_tarefa].estado_notificacao = NOTIFICACAO_NENHUMA;
+	Tarefas.tempo_espera[id_tarefa] = 0;
+	Tarefas.proxima_espera[id_tarefa] = 0;
+	Tarefas.anterior_espera[id_tarefa] = 0;
+	TCB[id_tarefa].espera_em = 0;
+	  
+	/* colocar a tarefa no fim da lista de prontas da sua prioridade */
+	tarefa_pronta(id_tarefa);
+	
+	/* criada depois de iniciar o multitarefas, com maior prioridade que a atual */
+	if(tarefa_atual != 0 && tarefa_mais_prioritaria_pronta())
+	{
+		PEDE_TROCA_CONTEXTO();
+	}
+	
+	REG_ATOMICA_RESTAURA(estado);
+	
+	return id_tarefa;
+}
+
+/* Cria uma tarefa com pilha estatica. Pode ser chamada antes ou depois de
+ * IniciaMultitarefas. Retorna o identificador da tarefa ou 0 se nao foi criada */
+uint8_t CriaTarefa(tarefa_t p, const char * nome,
+stackptr_t pilha, uint16_t tamanho, prioridade_t prioridade)
+{
+	
+	if(tamanho < TAM_MINIMO_PILHA)
+	{
+		return 0;
+	}
+	
+	return tarefa_cria(p, nome, pilha, tamanho, prioridade, 0);
+}
+
+/* Cria uma tarefa com a pilha alocada de um conjunto de blocos (pilhas), que
+ * e devolvida ao conjunto quando a tarefa e excluida. O tamanho da pilha e o 
+ * tamanho do bloco. Retorna o identificador da tarefa ou 0 se nao foi criada */
+uint8_t CriaTarefaDinamica(tarefa_t p, const char * nome, memoria_t* pilhas, prioridade_t prioridade)
+{
+	stackptr_t pilha;
+	uint8_t id_tarefa;
+	
+	if(pilhas->tam_bloco < TAM_MINIMO_PILHA * sizeof(uint32_t))
+	{
+		return 0;
+	}
+	
+	pilha = (stackptr_t)MemoriaAloca(pilhas);
+	if(pilha == 0)
+	{
+		return 0;
+	}
+	
+	id_tarefa = tarefa_cria(p, nome, pilha, pilhas->tam_bloco / sizeof(uint32_t), prioridade, pilhas);
+	if(id_tarefa == 0)
+	{
+		MemoriaLibera(pilhas, pilha);
+	}
+	return id_tarefa;
+}
+
+/* libera o TCB e a pilha de uma tarefa excluida, que nao esta executando.
+   Deve ser chamada com as interrupcoes bloqueadas */
+static void tarefa_libera(uint8_t id_tarefa)
+{
+	if(TCB[id_tarefa].memoria_pilha != 0)
+	{
+		MemoriaLibera(TCB[id_tarefa].memoria_pilha, TCB[id_tarefa].pilha);
+		TCB[id_tarefa].memoria_pilha = 0;
+	}
+	Tarefas.estado[id_tarefa] = LIVRE;
+}
+
+/* libera as tarefas que se excluiram, chamada pela tarefa ociosa */
+static void tarefas_limpa(void)
+{
+	uint16_t id_tarefa;
+	
+	REG_ATOMICA_INICIO();
+	for(id_tarefa = 1; id_tarefa <= numero_tarefas && tarefas_excluidas != 0; id_tarefa++)
+	{
+		if(Tarefas.estado[id_tarefa] == EXCLUIDA)
+		{
+			tarefa_libera(id_tarefa);
+			tarefas_excluidas--;
+		}
+	}
+	REG_ATOMICA_FIM();
+}
+
+void TarefaSuspende(uint8_t id_tarefa)
+{
+	REG_ATOMICA_INICIO();
+	tarefa_bloqueia(id_tarefa); 	/* tarefa colocada em espera */
+	TrocaContexto(); 		   		/* tarefa atual solicita troca de contexto */
+	REG_ATOMICA_FIM();
+}
+
+/* Exclui a tarefa, retirando-a de todas as listas. Se for a propria tarefa atual, ela
+ * nao retorna e a sua pilha so e liberada depois pela tarefa ociosa, pois ainda esta em
+ * uso ate a troca de contexto. Uma tarefa com mutexes travados nao e excluida, pois os
+ * mutexes ficariam com um dono que nao existe: retorna FALHA. Se a tarefa esperava um
+ * mutex, o dono deixa de herdar a sua prioridade */
+resultado_t TarefaExclui(uint8_t id_tarefa)
+{
+	mutex_t *mutex;
+	
+	REG_ATOMICA_INICIO();
+	
+	if(TCB[id_tarefa].mutexes != 0)
+	{
+		REG_ATOMICA_FIM();
+		return FALHA;
+	}
+	
+	tarefa_bloqueia(id_tarefa);				/* retira da lista de prontas */
+	atraso_remove(id_tarefa);				/* cancela a espera por tempo, se houver */
+	espera_remove(id_tarefa);				/* cancela a espera por um objeto, se houver */
+	
+	mutex = TCB[id_tarefa].mutex_esperado;
+	if(mutex != 0)
+	{
+		TCB[id_tarefa].mutex_esperado = 0;
+		heranca_propaga(mutex);
+	}
+	
+	if(id_tarefa == tarefa_atual)
+	{
+		Tarefas.estado[id_tarefa] = EXCLUIDA;
+		tarefas_excluidas++;
+		TROCA_CONTEXTO();					/* nao volta mais */
+		for(;;);
+	}
+	
+	tarefa_libera(id_tarefa);
+	
+	REG_ATOMICA_FIM();
+	
+	return SUCESSO;
+}
+
+/* Funcao para onde a tarefa vai se retornar da sua funcao principal (endereco de
+ * retorno colocado na pilha por CriaContexto): exclui a propria tarefa */
+void TarefaTermina(void)
+{
+	(void)TarefaExclui(tarefa_atual);
+	
+	/* so chega aqui se a tarefa retornou com mutexes travados */
+	REG_ATOMICA_INICIO();
+	for(;;);		/* para aqui para o depurador mostrar a tarefa em TCB[tarefa_atual] */
+}
+
+void TarefaContinua(uint8_t id_tarefa)
+{
+	REG_ATOMICA_INICIO();
+	atraso_remove(id_tarefa);				/* cancela a espera por tempo, se houver */
+	espera_remove(id_tarefa);				/* cancela a espera por um objeto, se houver */
+	tarefa_pronta(id_tarefa);				/* tarefa colocada na fila de prontas */
+	troca_se_necessario();					/* troca de contexto se a tarefa tem maior prioridade */
+	REG_ATOMICA_FIM();
+}
+
+void TarefaEspera(tick_t qtas_marcas)
+{
+	if(qtas_marcas > 0)  //** so valores maiores que 0 */
+	{
+		REG_ATOMICA_INICIO();			/* bloqueia interrupcoes */
+		atraso_insere(tarefa_atual, qtas_marcas);		/* tarefa colocada na lista de atrasos com o valor recebido */
+		tarefa_bloqueia(tarefa_atual);					/* tarefa colocada na fila de espera */
+		TrocaContexto(); 	 /* tarefa atual solicita troca de contexto, so retorna quando ficar pronta novamente */
+		REG_ATOMICA_FIM();   /* desbloqueia interrupcoes */
+	}
+}
+
+/* Servicos de notificacao direta para tarefas: cada tarefa tem um valor de notificacao 
+ * no seu TCB, que pode ser usado no lugar de um semaforo, grupo de eventos ou fila de
+ * uma mensagem quando se sabe qual tarefa deve ser avisada, sem precisar de outro objeto */
+
+/* entrega a notificacao e acorda a tarefa se ela estava aguardando. 
+   Deve ser chamada com as interrupcoes bloqueadas */
+static resultado_t notificacao_entrega(uint8_t id_tarefa, uint32_t valor, acao_notificacao_t acao)
+{
+	uint8_t anterior = TCB[id_tarefa].estado_notificacao;
+	
+	switch(acao)
+	{
+		case NOTIFICA_LIGA_BITS:
+			TCB[id_tarefa].notificacao |= valor;
+			break;
+		case NOTIFICA_INCREMENTA:
+			TCB[id_tarefa].notificacao++;
+			break;
+		case NOTIFICA_SOBRESCREVE:
+			TCB[id_tarefa].notificacao = valor;
+			break;
+		case NOTIFICA_SEM_SOBRESCREVER:
+			if(anterior == NOTIFICACAO_PENDENTE)
+			{
+				return FALHA;	/* a notificacao anterior ainda nao foi recebida */
+			}
+			TCB[id_tarefa].notificacao = valor;
+			break;
+		default:
+			break;
+	}
+	
+	TCB[id_tarefa].estado_notificacao = NOTIFICACAO_PENDENTE;
+	
+	if(anterior == NOTIFICACAO_AGUARDANDO)
+	{
+		atraso_remove(id_tarefa);
+		TCB[id_tarefa].resultado = SUCESSO;
+		tarefa_pronta(id_tarefa);
+		LATENCIA_ACORDA(id_tarefa);
+	}
+	return SUCESSO;
+}
+
+/* a tarefa atual aguarda uma notificacao por ate tempo_limite marcas de tempo.
+   Deve ser chamada com as interrupcoes bloqueadas, e retorna com elas bloqueadas */
+static void notificacao_bloqueia(tick_t tempo_limite)
+{
+	TCB[tarefa_atual].estado_notificacao = NOTIFICACAO_AGUARDANDO;
+	TCB[tarefa_atual].resultado = TEMPO_ESGOTADO;
+	tarefa_bloqueia(tarefa_atual);
+	if(tempo_limite != ESPERA_INFINITA)
+	{
+		atraso_insere(tarefa_atual, tempo_limite);
+	}
+	TROCA_CONTEXTO();			/* so retorna quando for notificada ou o tempo esgotar */
+	LATENCIA_RETOMA(CAMINHO_NOTIFICACAO);
+	REG_ATOMICA_INICIO();
+}
+
+/* Notifica a tarefa id_tarefa, alterando o valor da sua notificacao conforme a acao.
+ * Retorna FALHA se a acao for NOTIFICA_SEM_SOBRESCREVER e havia notificacao pendente */
+resultado_t TarefaNotifica(uint8_t id_tarefa, uint32_t valor, acao_notificacao_t acao)
+{
+	resultado_t resultado;
+	
+	REG_ATOMICA_INICIO();
+	resultado = notificacao_entrega(id_tarefa, valor, acao);
+	troca_se_necessario();		/* so troca o contexto se acordou uma tarefa de maior prioridade */
+	REG_ATOMICA_FIM();
+	
+	return resultado;
+}
+
+/* Versao de TarefaNotifica para uso dentro de rotinas de interrupcao */
+resultado_t TarefaNotificaDaISR(uint8_t id_tarefa, uint32_t valor, acao_notificacao_t acao)
+{
+	resultado_t resultado;
+	uint32_t estado;
+	
+	REG_ATOMICA_SALVA(estado);
+	resultado = notificacao_entrega(id_tarefa, valor, acao);
+	if(tarefa_mais_prioritaria_pronta())
+	{
+		PEDE_TROCA_CONTEXTO();
+	}
+	REG_ATOMICA_RESTAURA(estado);
+	
+	return resultado;
+}
+
+/* Recebe a notificacao usada como semaforo contador: espera ate a notificacao ser 
+ * diferente de zero e entao a decrementa (ou zera, se zera for diferente de zero). 
+ * Retorna o valor da notificacao antes de decrementar, ou 0 se o tempo esgotou */
+uint32_t TarefaNotificacaoRecebe(uint8_t zera, tick_t tempo_limite)
+{
+	uint32_t valor;
+	
+	REG_ATOMICA_INICIO();
+	
+	if(TCB[tarefa_atual].notificacao == 0 && tempo_limite != NAO_ESPERA)
+	{
+		notificacao_bloqueia(tempo_limite);
+	}
+	
+	valor = TCB[tarefa_atual].notificacao;
+	if(valor != 0)
+	{
+		TCB[tarefa_atual].notificacao = zera ? 0 : valor - 1;
+	}
+	TCB[tarefa_atual].estado_notificacao = NOTIFICACAO_NENHUMA;
+	
+	REG_ATOMICA_FIM();
+	
+	return valor;
+}
+
+/* Aguarda uma notificacao pendente. Os bits limpa_entrada sao desligados antes de 
+ * esperar (se nao houver notificacao pendente) e os bits limpa_saida depois de receber.
+ * Se valor nao for nulo, recebe o valor da notificacao */
+resultado_t TarefaNotificacaoAguarda(uint32_t limpa_entrada, uint32_t limpa_saida, uint32_t* valor, tick_t tempo_limite)
+{
+	resultado_t resultado = TEMPO_ESGOTADO;
+	
+	REG_ATOMICA_INICIO();
+	
+	if(TCB[tarefa_atual].estado_notificacao != NOTIFICACAO_PENDENTE)
+	{
+		TCB[tarefa_atual].notificacao &= ~limpa_entrada;
+		if(tempo_limite != NAO_ESPERA)
+		{
+			notificacao_bloqueia(tempo_limite);
+		}
+	}
+	
+	if(valor != 0)
+	{
+		*valor = TCB[tarefa_atual].notificacao;
+	}
+	
+	if(TCB[tarefa_atual].estado_notificacao == NOTIFICACAO_PENDENTE)
+	{
+		TCB[tarefa_atual].notificacao &= ~limpa_saida;
+		resultado = SUCESSO;
+	}
+	TCB[tarefa_atual].estado_notificacao = NOTIFICACAO_NENHUMA;
+	
+	REG_ATOMICA_FIM();
+	
+	return resultado;
+}
+
+/* Exemplo de tarefa ociosa */
+void tarefa_ociosa(void)
+{
+#if cfg_VERIFICA_PILHA
+	uint8_t pilha_medida = 0;
+#endif
+	
+#if cfg_TEMPO_DE_EXECUCAO
+	tarefa_da_ociosa = tarefa_atual;
+#endif
+	
+	for(;;)
+	{		
+		if(tarefas_excluidas != 0)
+		{
+			tarefas_limpa();
+		}
+		
+		#if cfg_VERIFICA_PILHA
+			/* mede uma pilha por vez, fora da troca de contexto e sem bloquear as interrupcoes */
+			if(pilha_medida >= numero_tarefas)
+			{
+				pilha_medida = 1;
+			}else
+			{
+				pilha_medida++;
+			}
+			if(Tarefas.estado[pilha_medida] != LIVRE)
+			{
+				(void)pilha_mede(pilha_medida);
+			}
+		#endif
+		
+		#if cfg_MODO_SEM_MARCA
+			tick_t ociosas;
+			
+			REG_ATOMICA_INICIO();
+			
+			/* marcas de tempo ate a primeira tarefa da lista de atrasos acordar */
+			ociosas = (lista_atrasos != 0) ? Tarefas.tempo_espera[lista_atrasos] : (tick_t)~0;
+			
+			/* e ate a proxima raia com temporizadores */
+			if(temporizadores_proximo() < ociosas)
+			{
+				ociosas = temporizadores_proximo();
+			}
+			
+			/* so desliga a marca de tempo se nenhuma outra tarefa estiver pronta
+			 * e se o tempo ocioso compensar o custo de dormir e acordar */
+			if(prontas_maior_prioridade() == 0 && Tarefas.proxima[tarefa_atual] == tarefa_atual &&
+				ociosas >= cfg_OCIOSO_MINIMO)
+			{
+				/* a CPU dorme (com as interrupcoes bloqueadas, mas ainda acordando com elas)
+				 * e no retorno a contagem de tempo e corrigida com as marcas que passaram */
+				ociosas = DormeSemMarcaDeTempo(ociosas);
+				marcas_avanca(ociosas);
+				temporizadores_verifica(ociosas);
+			}
+			
+			REG_ATOMICA_FIM();
+		#endif
+		
+		#if 1
+			REG_ATOMICA_INICIO();
+			TrocaContexto();				/* tarefa atual solicita troca de contexto */
+			REG_ATOMICA_FIM();
+		#endif
+	}
+}
+
+
+void IniciaMultitarefas(void)
+{
+	tarefa_atual = escalonador();
+#if cfg_TEMPO_DE_EXECUCAO
+	inicio_execucao = LE_CONTADOR_TEMPO();
+#endif
+	GERA_INTERRUPCAO_SW(TCB[tarefa_atual].stack_pointer);
+}
+
+/* Chamada pela troca de contexto com o stack pointer que a tarefa atual tera depois de
+ * salvar o seu contexto. Retorna o stack pointer da nova tarefa ou NULL se a tarefa 
+ * atual continua, caso em que a troca de contexto nao precisa salvar nem restaurar nada */
+NA_RAM stackptr_t TrocaContextoDasTarefas(stackptr_t sp)
+{
+	
+	/* guarda o valor antigo do stack pointer */
+	TCB[tarefa_atual].stack_pointer = sp;
+	
+#if cfg_VERIFICA_PILHA
+	/* a ultima palavra da pilha foi sobrescrita ou o stack pointer passou do fim da pilha */
+	if(TCB[tarefa_atual].pilha[0] != PADRAO_PILHA || sp < TCB[tarefa_atual].pilha)
+	{
+		TarefaEstouroPilha(tarefa_atual);
+	}
+#endif
+		
+#if cfg_TEMPO_DE_EXECUCAO
+	{
+		/* soma o tempo que a tarefa executou desde a ultima troca de contexto */
+		uint32_t agora = LE_CONTADOR_TEMPO();
+		TCB[tarefa_atual].tempo_execucao += agora - inicio_execucao;
+		inicio_execucao = agora;
+	}
+#endif
+	
+	/* executa o escalonador */
+	proxima_tarefa = escalonador();
+		
+	if(proxima_tarefa == tarefa_atual)
+	{
+		return NULL;
+	}
+	
+	contador_trocas++;
+	RASTRO(RASTRO_SAI, tarefa_atual, 0);
+	RASTRO(RASTRO_ENTRA, proxima_tarefa, 0);
+	
+#if cfg_PREEMPTIVO && cfg_FATIA_TEMPO > 0
+	/* a tarefa selecionada comeca com uma fatia de tempo completa */
+	fatia_restante = cfg_FATIA_TEMPO;
+#endif
+
+	/* seleciona a nova tarefa e retorna o seu stack pointer */
+	tarefa_atual = proxima_tarefa;
+	
+	return TCB[tarefa_atual].stack_pointer;
+}
+#if cfg_TEMPO_DE_EXECUCAO
+/* tempo ocioso total ate agora, incluindo a parte ainda nao somada se a tarefa 
+   ociosa estiver executando. Deve ser chamada com as interrupcoes bloqueadas */
+static uint32_t tempo_ocioso(uint32_t agora)
+{
+	uint32_t ocioso = TCB[tarefa_da_ociosa].tempo_execucao;
+	
+	if(tarefa_atual == tarefa_da_ociosa)
+	{
+		ocioso += agora - inicio_execucao;
+	}
+	return ocioso;
+}
+
+/* fecha a janela da carga da CPU: a carga e a parte do tempo da janela em que a 
+   tarefa ociosa nao executou, em milesimos. Chamada pela marca de tempo */
+static void carga_cpu_atualiza(void)
+{
+	uint32_t agora = LE_CONTADOR_TEMPO();
+	uint32_t ocioso = tempo_ocioso(agora);
+	uint32_t janela = agora - inicio_janela;
+	uint32_t ocioso_janela = ocioso - ocioso_inicio_janela;
+	
+	if(janela != 0 && ocioso_janela <= janela)
+	{
+		/* divide os dois antes para nao estourar 32 bits na multiplicacao */
+		carga_cpu = (uint16_t)(1000 - ((ocioso_janela >> 10) * 1000) / ((janela >> 10) + 1));
+	}
+	
+	ocioso_inicio_janela = ocioso;
+	inicio_janela = agora;
+	janela_restante = cfg_JANELA_CARGA;
+}
+#endif
+
+/* Retorna o tempo total de execucao da tarefa, em contagens do contador de tempo 
+ * (CONTADOR_TEMPO_HZ). Necessita de cfg_TEMPO_DE_EXECUCAO, caso contrario retorna 0 */
+uint32_t TarefaTempoExecucao(uint8_t id_tarefa)
+{
+#if cfg_TEMPO_DE_EXECUCAO
+	uint32_t tempo;
+	
+	REG_ATOMICA_INICIO();
+	tempo = TCB[id_tarefa].tempo_execucao;
+	if(id_tarefa == tarefa_atual)
+	{
+		tempo += LE_CONTADOR_TEMPO() - inicio_execucao;
+	}
+	REG_ATOMICA_FIM();
+	
+	return tempo;
+#else
+	return 0;
+#endif
+}
+
+/* Retorna a carga da CPU, em milesimos, na ultima janela de cfg_JANELA_CARGA marcas
+ * de tempo. Necessita de cfg_TEMPO_DE_EXECUCAO, caso contrario retorna 0 */
+uint16_t CargaCPU(void)
+{
+#if cfg_TEMPO_DE_EXECUCAO
+	return carga_cpu;
+#else
+	return 0;
+#endif
+}
+
+/* executa a marca de tempo e retorna 1 se a tarefa atual deve ser trocada, isto e,
+   se ficou pronta uma tarefa de maior prioridade que a atual ou se terminou a fatia 
+   de tempo da tarefa atual. Caso contrario retorna 0 e nao ha troca de contexto */
+NA_RAM uint8_t ExecutaMarcaDeTempo(void)
+{
+	uint8_t troca;
+	
+	marcas_avanca(1);
+	temporizadores_verifica(1);
+	RASTRO(RASTRO_MARCA, tarefa_atual, contador_marcas);
+	
+#if cfg_TEMPO_DE_EXECUCAO
+	if(--janela_restante == 0)
+	{
+		carga_cpu_atualiza();
+	}
+#endif
+	
+	/* compara a maior prioridade pronta com a da tarefa atual (tempo constante) */
+	troca = tarefa_mais_prioritaria_pronta();
+
+#if cfg_PREEMPTIVO && cfg_FATIA_TEMPO > 0
+	/* fim da fatia de tempo: se houver outra tarefa pronta com a mesma prioridade,
+	 * a tarefa atual vai para o fim da fila (round-robin) e e solicitada a troca de contexto */
+	if(--fatia_restante == 0)
+	{
+		fatia_restante = cfg_FATIA_TEMPO;
+		
+		if(Tarefas.estado[tarefa_atual] == PRONTA && Tarefas.proxima[tarefa_atual] != tarefa_atual)
+		{
+			Prioridades[Tarefas.prioridade[tarefa_atual]] = Tarefas.proxima[tarefa_atual];
+			troca = 1;
+		}
+	}
+#endif
+
+	return troca;
+}
+
+/* Servicos de semaforos */
+
+/* Aguarda o semaforo por ate tempo_limite marcas de tempo (NAO_ESPERA, um valor 
+ * ou ESPERA_INFINITA). Retorna SUCESSO se recebeu o semaforo ou TEMPO_ESGOTADO */
+NA_RAM resultado_t SemaforoAguardaTempo(semaforo_t* sem, tick_t tempo_limite)
+{
+	resultado_t resultado = SUCESSO;
+	
+	REG_ATOMICA_INICIO();
+	
+	if(sem->contador > 0)
+	{
+		sem->contador--;
+		RASTRO(RASTRO_SEMAFORO_AGUARDA, tarefa_atual, (uintptr_t)sem);
+	}else if(tempo_limite == NAO_ESPERA)
+	{
+		resultado = TEMPO_ESGOTADO;
+	}else
+	{
+		RASTRO(RASTRO_SEMAFORO_BLOQUEIA, tarefa_atual, (uintptr_t)sem);
+		espera_bloqueia(&sem->espera, tempo_limite, CAMINHO_SEMAFORO);	/* so retorna quando receber o semaforo ou o tempo esgotar */
+		REG_ATOMICA_INICIO();
+		resultado = TCB[tarefa_atual].resultado;
+	}
+	
+	REG_ATOMICA_FIM();
+	
+	return resultado;
+}
+
+
+NA_RAM void SemaforoLibera(semaforo_t* sem)
+{
+	
+	REG_ATOMICA_INICIO();
+	
+	RASTRO(RASTRO_SEMAFORO_LIBERA, tarefa_atual, (uintptr_t)sem);
+	
+	/* entrega o semaforo diretamente a tarefa de maior prioridade aguardando */
+	if(espera_acorda(&sem->espera) == 0)
+	{	/* nao tem tarefa aguardando */
+		sem->contador++;
+	}
+	troca_se_necessario();		/* so troca o contexto se acordou uma tarefa de maior prioridade */
+	
+	REG_ATOMICA_FIM();
+}
+
+/* Servicos de mutex */
+
+/* muda a prioridade de uma tarefa, mantendo-a na posicao certa da lista de prontas
+   (Prioridades[]) ou da lista de espera em que ela estiver */
+static void tarefa_muda_prioridade(uint8_t id_tarefa, prioridade_t prioridade)
+{
+	lista_espera_t *lista = TCB[id_tarefa].espera_em;
+	
+	if(Tarefas.estado[id_tarefa] == PRONTA)
+	{
+		tarefa_bloqueia(id_tarefa);
+		Tarefas.prioridade[id_tarefa] = prioridade;
+		tarefa_pronta(id_tarefa);
+	}else if(lista != 0)
+	{
+		espera_remove(id_tarefa);
+		Tarefas.prioridade[id_tarefa] = prioridade;
+		espera_insere(lista, id_tarefa);
+	}else
+	{
+		Tarefas.prioridade[id_tarefa] = prioridade;
+	}
+}
+
+/* maior prioridade que a tarefa deve ter: a sua prioridade base ou a da tarefa
+   de maior prioridade esperando algum dos mutexes que ela travou */
+static prioridade_t prioridade_herdada(uint8_t id_tarefa)
+{
+	prioridade_t prioridade = TCB[id_tarefa].prioridade_base;
+	mutex_t *mutex;
+	
+	for(mutex = TCB[id_tarefa].mutexes; mutex != 0; mutex = mutex->proximo)
+	{
+		if(mutex->espera != 0 && Tarefas.prioridade[mutex->espera] > prioridade)
+		{
+			prioridade = Tarefas.prioridade[mutex->espera];
+		}
+	}
+	return prioridade;
+}
+
+/* Recalcula a prioridade do dono do mutex e, se o dono tambem espera um mutex, a do dono
+   deste, e assim por diante (heranca em cadeia), ate uma tarefa cuja prioridade nao muda.
+   Cada tarefa espera no maximo um mutex, entao a cadeia tem no maximo numero_tarefas 
+   donos; o limite tambem encerra o laco se a aplicacao criou um impasse (ciclo de mutexes) */
+static void heranca_propaga(mutex_t *mutex)
+{
+	uint16_t n;
+	uint8_t dono;
+	prioridade_t prioridade;
+	
+	for(n = 0; n < numero_tarefas && mutex != 0 && mutex->dono != 0; n++)
+	{
+		dono = mutex->dono;
+		prioridade = prioridade_herdada(dono);
+		if(prioridade == Tarefas.prioridade[dono])
+		{
+			break;
+		}
+		tarefa_muda_prioridade(dono, prioridade);
+		mutex = TCB[dono].mutex_esperado;
+	}
+}
+
+/* entrega o mutex a uma tarefa */
+static void mutex_entrega(mutex_t* mutex, uint8_t id_tarefa)
+{
+	mutex->dono = id_tarefa;
+	mutex->recursao = 1;
+	mutex->proximo = TCB[id_tarefa].mutexes;
+	TCB[id_tarefa].mutexes = mutex;
 }
- 
 
+/* retira o mutex da lista de mutexes travados pelo dono */
+static void mutex_retira_do_dono(mutex_t* mutex)
+{
+	mutex_t **m = &TCB[mutex->dono].mutexes;
+	
+	while(*m != mutex)
+	{
+		m = &(*m)->proximo;
+	}
+	*m = mutex->proximo;
+	mutex->proximo = 0;
+}
 
-/*********************************************/
-void CriaTarefa(tarefa_t p, const char * nome,
-stackptr_t pilha, uint16_t tamanho, prioridade_t prioridade)
+/* Trava o mutex, esperando por ate tempo_limite marcas de tempo. Se o mutex esta livre, 
+ * a tarefa se torna dona dele sem troca de contexto. Se ja e a dona, apenas incrementa 
+ * a contagem de recursao. Caso contrario a tarefa espera e o dono herda a sua prioridade,
+ * se for maior, para que uma tarefa de prioridade intermediaria nao atrase a liberacao 
+ * do mutex. Retorna SUCESSO se travou o mutex ou TEMPO_ESGOTADO */
+resultado_t MutexTravaTempo(mutex_t* mutex, tick_t tempo_limite)
 {
+	tick_t inicio;
+	resultado_t resultado = SUCESSO;
 	
-	if(tamanho < TAM_MINIMO_PILHA)
+	REG_ATOMICA_INICIO();
+	
+	if(mutex->dono == 0)
 	{
-		return;
+		mutex_entrega(mutex, tarefa_atual);		/* caminho rapido: mutex livre */
+	}else if(mutex->dono == tarefa_atual)
+	{
+		mutex->recursao++;						/* o dono travou de novo */
+	}else if(tempo_limite == NAO_ESPERA)
+	{
+		resultado = TEMPO_ESGOTADO;
+	}else
+	{
+		if(Tarefas.prioridade[mutex->dono] < Tarefas.prioridade[tarefa_atual])
+		{
+			/* heranca de prioridade, passada adiante se o dono tambem espera um mutex */
+			tarefa_muda_prioridade(mutex->dono, Tarefas.prioridade[tarefa_atual]);
+			heranca_propaga(TCB[mutex->dono].mutex_esperado);
+		}
+		
+		TCB[tarefa_atual].mutex_esperado = mutex;
+		inicio = contador_marcas;
+		espera_bloqueia(&mutex->espera, tempo_limite, CAMINHO_MUTEX);	/* so retorna quando receber o mutex ou o tempo esgotar */
+		
+		REG_ATOMICA_INICIO();
+		TCB[tarefa_atual].mutex_esperado = 0;
+		resultado = TCB[tarefa_atual].resultado;
+		if(resultado == SUCESSO)
+		{
+			if((tick_t)(contador_marcas - inicio) > mutex->bloqueio_max)
+			{
+				mutex->bloqueio_max = (tick_t)(contador_marcas - inicio);
+			}
+		}else
+		{
+			/* desistiu de esperar: o dono (e a cadeia de donos) deixa de herdar a
+			   prioridade desta tarefa */
+			heranca_propaga(mutex);
+		}
 	}
 	
-	pilha = CriaContexto(p, pilha + tamanho);
+	REG_ATOMICA_FIM();
 	
-	/* incrementa o numero de tarefas instaladas */
-	numero_tarefas++;
-
-	/* guardar os dados no bloco de controle da tarefa (TCB) */
-	TCB[numero_tarefas].nome = nome;
-	TCB[numero_tarefas].stack_pointer = (stackptr_t)(pilha);
-	TCB[numero_tarefas].estado = PRONTA;
-	TCB[numero_tarefas].prioridade = prioridade;
-	TCB[numero_tarefas].tempo_espera = 0;
-	  
-	/* guardar o numero da tarefa (TCB) no vetor de prioridades das tarefas */
-	Prioridades[prioridade]=numero_tarefas;
+	return resultado;
+}
 
+/* Libera o mutex. Somente o dono pode liberar. Na ultima liberacao, o dono volta a
+ * prioridade que deve ter sem este mutex e o mutex e entregue diretamente a tarefa 
+ * de maior prioridade que o esperava */
+void MutexLibera(mutex_t* mutex)
+{
+	uint8_t tarefa;
+	
+	REG_ATOMICA_INICIO();
+	
+	if(mutex->dono == tarefa_atual && --mutex->recursao == 0)
+	{
+		mutex_retira_do_dono(mutex);
+		
+		if(Tarefas.prioridade[tarefa_atual] != TCB[tarefa_atual].prioridade_base)
+		{
+			/* desfaz a heranca de prioridade deste mutex */
+			tarefa_muda_prioridade(tarefa_atual, prioridade_herdada(tarefa_atual));
+		}
+		
+		tarefa = espera_retira(&mutex->espera);
+		if(tarefa > 0)
+		{
+			mutex_entrega(mutex, tarefa);
+			TCB[tarefa].mutex_esperado = 0;
+			
+			/* o novo dono herda a prioridade das tarefas que continuam esperando */
+			if(mutex->espera != 0 && Tarefas.prioridade[mutex->espera] > Tarefas.prioridade[tarefa])
+			{
+				Tarefas.prioridade[tarefa] = Tarefas.prioridade[mutex->espera];
+			}
+			tarefa_acorda(tarefa);		/* cancela o tempo limite e coloca na fila de pronta */
+		}else
+		{
+			mutex->dono = 0;
+		}
+		troca_se_necessario();
+	}
+	
+	REG_ATOMICA_FIM();
 }
 
+/* Servicos de filas de mensagens */
 
+/* copia uma mensagem de tam bytes */
+static void copia_mensagem(void *destino, const void *origem, uint8_t tam)
+{
+	uint8_t *d = (uint8_t *)destino;
+	const uint8_t *o = (const uint8_t *)origem;
+	
+	while(tam--)
+	{
+		*d++ = *o++;
+	}
+}
 
-/* Servicos do gerenciador de tarefas */
-void TarefaSuspende(uint8_t id_tarefa)
+/* Envia uma mensagem para a fila. Se alguma tarefa esta esperando mensagem, a fila 
+ * esta vazia e a mensagem e copiada diretamente para ela. Se a fila esta cheia, a 
+ * tarefa espera ate tempo_limite marcas de tempo por espaco (NAO_ESPERA retorna 
+ * imediatamente e ESPERA_INFINITA espera sem limite). */
+resultado_t FilaEnvia(fila_t* fila, const void* mensagem, tick_t tempo_limite)
 {
+	resultado_t resultado = SUCESSO;
+	uint8_t fim;
+	
 	REG_ATOMICA_INICIO();
-	TCB[id_tarefa].estado = ESPERA; /* tarefa colocada em espera */
-	TrocaContexto(); 		   		/* tarefa atual solicita troca de contexto */
+	
+	if(fila->espera_recepcao != 0)
+	{
+		/* entrega direto para a tarefa de maior prioridade esperando */
+		copia_mensagem(TCB[fila->espera_recepcao].mensagem, mensagem, fila->tam_mensagem);
+		espera_acorda(&fila->espera_recepcao);
+		troca_se_necessario();
+	}else if(fila->quantidade < fila->capacidade)
+	{
+		fim = (uint8_t)((fila->inicio + fila->quantidade) % fila->capacidade);
+		copia_mensagem(&fila->mensagens[fim * fila->tam_mensagem], mensagem, fila->tam_mensagem);
+		fila->quantidade++;
+	}else if(tempo_limite == NAO_ESPERA)
+	{
+		resultado = TEMPO_ESGOTADO;
+	}else
+	{
+		/* a mensagem sera copiada por quem abrir espaco na fila */
+		TCB[tarefa_atual].mensagem = (void *)mensagem;
+		espera_bloqueia(&fila->espera_envio, tempo_limite, CAMINHO_FILA);
+		resultado = (resultado_t)TCB[tarefa_atual].resultado;
+	}
+	
 	REG_ATOMICA_FIM();
+	
+	return resultado;
 }
 
-void TarefaContinua(uint8_t id_tarefa)
+/* Recebe a mensagem mais antiga da fila. Se a fila esta vazia, a tarefa espera ate 
+ * tempo_limite marcas de tempo por uma mensagem. Ao abrir espaco, a mensagem da 
+ * tarefa de maior prioridade esperando para enviar e colocada na fila */
+resultado_t FilaRecebe(fila_t* fila, void* mensagem, tick_t tempo_limite)
 {
+	resultado_t resultado = SUCESSO;
+	uint8_t fim;
+	
 	REG_ATOMICA_INICIO();
-	TCB[id_tarefa].estado = PRONTA;			/* tarefa colocada na fila de prontas */
-	TrocaContexto(); 		   				/* tarefa atual solicita troca de contexto */
+	
+	if(fila->quantidade > 0)
+	{
+		copia_mensagem(mensagem, &fila->mensagens[fila->inicio * fila->tam_mensagem], fila->tam_mensagem);
+		fila->inicio = (uint8_t)((fila->inicio + 1) % fila->capacidade);
+		fila->quantidade--;
+		
+		if(fila->espera_envio != 0)
+		{
+			fim = (uint8_t)((fila->inicio + fila->quantidade) % fila->capacidade);
+			copia_mensagem(&fila->mensagens[fim * fila->tam_mensagem], TCB[fila->espera_envio].mensagem, fila->tam_mensagem);
+			fila->quantidade++;
+			espera_acorda(&fila->espera_envio);
+			troca_se_necessario();
+		}
+	}else if(tempo_limite == NAO_ESPERA)
+	{
+		resultado = TEMPO_ESGOTADO;
+	}else
+	{
+		/* a mensagem sera copiada por quem enviar */
+		TCB[tarefa_atual].mensagem = mensagem;
+		espera_bloqueia(&fila->espera_recepcao, tempo_limite, CAMINHO_FILA);
+		resultado = (resultado_t)TCB[tarefa_atual].resultado;
+	}
+	
 	REG_ATOMICA_FIM();
+	
+	return resultado;
 }
 
-void TarefaEspera(tick_t qtas_marcas)
+/* Servicos de grupos de eventos */
+
+/* verifica se os eventos do grupo satisfazem a espera de uma tarefa */
+static uint8_t eventos_satisfeitos(uint32_t eventos, uint32_t aguardados, uint8_t opcoes)
 {
-	if(qtas_marcas > 0)  //** so valores maiores que 0 */
+	if(opcoes & EVENTOS_TODOS)
 	{
-		REG_ATOMICA_INICIO();			/* bloqueia interrupcoes */
-		TCB[tarefa_atual].tempo_espera = qtas_marcas;	/* contador de marcas da tarefa iniciado com o valor recebido */
-		TCB[tarefa_atual].estado = ESPERA;				/* tarefa colocada na fila de espera */
-		TrocaContexto(); 	 /* tarefa atual solicita troca de contexto, so retorna quando ficar pronta novamente */
-		REG_ATOMICA_FIM();   /* desbloqueia interrupcoes */
+		return ((eventos & aguardados) == aguardados);
 	}
+	return ((eventos & aguardados) != 0);
 }
 
-/* Exemplo de tarefa ociosa */
-void tarefa_ociosa(void)
+/* liga os eventos no grupo e acorda, em uma unica passagem pela lista de espera, 
+   todas as tarefas cuja espera foi satisfeita. Os eventos das tarefas que pediram 
+   EVENTOS_LIMPA so sao desligados depois da passagem, para que todas vejam os 
+   mesmos eventos. Deve ser chamada com as interrupcoes bloqueadas */
+static void eventos_sinaliza(grupo_eventos_t* grupo, uint32_t eventos)
 {
+	uint8_t tarefa = grupo->espera;
+	uint8_t proxima, ultima;
+	uint32_t limpar = 0;
+	
+	grupo->eventos |= eventos;
+	
+	if(tarefa == 0)
+	{
+		return;
+	}
 	
+	ultima = Tarefas.anterior[tarefa];
 	for(;;)
-	{		
-		#if 1
-			REG_ATOMICA_INICIO();
-			TrocaContexto();				/* tarefa atual solicita troca de contexto */
-			REG_ATOMICA_FIM();
-		#endif
+	{
+		proxima = Tarefas.proxima[tarefa];
+		
+		if(eventos_satisfeitos(grupo->eventos, TCB[tarefa].eventos, TCB[tarefa].opcoes_eventos))
+		{
+			if(TCB[tarefa].opcoes_eventos & EVENTOS_LIMPA)
+			{
+				limpar |= TCB[tarefa].eventos;
+			}
+			TCB[tarefa].eventos = grupo->eventos;	/* a tarefa recebe os eventos que a acordaram */
+			tarefa_acorda(tarefa);
+		}
+		
+		if(tarefa == ultima)
+		{
+			break;
+		}
+		tarefa = proxima;
 	}
+	
+	grupo->eventos &= ~limpar;
 }
 
+/* Espera pelos eventos indicados em aguardados: qualquer um deles (EVENTOS_QUALQUER)
+ * ou todos (EVENTOS_TODOS). Com EVENTOS_LIMPA, os eventos aguardados sao desligados 
+ * ao sair da espera. Retorna TEMPO_ESGOTADO se os eventos nao ocorrerem em tempo_limite
+ * marcas de tempo. Se eventos nao for nulo, recebe os eventos do grupo que satisfizeram a espera */
+resultado_t EventosAguarda(grupo_eventos_t* grupo, uint32_t aguardados, uint8_t opcoes, uint32_t* eventos, tick_t tempo_limite)
+{
+	resultado_t resultado = SUCESSO;
+	uint32_t recebidos = 0;
+	
+	REG_ATOMICA_INICIO();
+	
+	if(eventos_satisfeitos(grupo->eventos, aguardados, opcoes))
+	{
+		recebidos = grupo->eventos;
+		if(opcoes & EVENTOS_LIMPA)
+		{
+			grupo->eventos &= ~aguardados;
+		}
+	}else if(tempo_limite == NAO_ESPERA)
+	{
+		resultado = TEMPO_ESGOTADO;
+	}else
+	{
+		TCB[tarefa_atual].eventos = aguardados;
+		TCB[tarefa_atual].opcoes_eventos = opcoes;
+		espera_bloqueia(&grupo->espera, tempo_limite, CAMINHO_EVENTOS);
+		
+		resultado = (resultado_t)TCB[tarefa_atual].resultado;
+		recebidos = (resultado == SUCESSO) ? TCB[tarefa_atual].eventos : grupo->eventos;
+	}
+	
+	REG_ATOMICA_FIM();
+	
+	if(eventos != 0)
+	{
+		*eventos = recebidos;
+	}
+	return resultado;
+}
 
-void IniciaMultitarefas(void)
+/* Liga eventos no grupo, acordando todas as tarefas cuja espera foi satisfeita */
+void EventosSinaliza(grupo_eventos_t* grupo, uint32_t eventos)
 {
-	tarefa_atual = escalonador();
-	ponteiro_de_pilha = TCB[tarefa_atual].stack_pointer;
-	SP = ponteiro_de_pilha;
-	GERA_INTERRUPCAO_SW();
+	REG_ATOMICA_INICIO();
+	eventos_sinaliza(grupo, eventos);
+	troca_se_necessario();		/* so troca o contexto se acordou uma tarefa de maior prioridade */
+	REG_ATOMICA_FIM();
 }
 
-void TrocaContextoDasTarefas(void)
+/* Versao de EventosSinaliza para uso dentro de rotinas de interrupcao: preserva o
+ * estado das interrupcoes e apenas pendura a PendSV, que executa ao fim da interrupcao */
+void EventosSinalizaDaISR(grupo_eventos_t* grupo, uint32_t eventos)
 {
+	uint32_t estado;
 	
-	/* guarda o valor antigo do stack pointer */
-	TCB[tarefa_atual].stack_pointer = SP;
-		
-	/* executa o escalonador */
-	proxima_tarefa = escalonador();
-		
-	/* seleciona a nova tarefa */
-	tarefa_atual = proxima_tarefa;
-		
-	/* coloca um novo valor no stack pointer */
-	ponteiro_de_pilha = TCB[tarefa_atual].stack_pointer;
-		
-	SP = ponteiro_de_pilha;
+	REG_ATOMICA_SALVA(estado);
+	eventos_sinaliza(grupo, eventos);
+	if(tarefa_mais_prioritaria_pronta())
+	{
+		PEDE_TROCA_CONTEXTO();
+	}
+	REG_ATOMICA_RESTAURA(estado);
+}
+
+/* Desliga eventos no grupo */
+void EventosLimpa(grupo_eventos_t* grupo, uint32_t eventos)
+{
+	uint32_t estado;
+	
+	REG_ATOMICA_SALVA(estado);
+	grupo->eventos &= ~eventos;
+	REG_ATOMICA_RESTAURA(estado);
+}
+
+/* Servicos de temporizadores de software: os temporizadores ficam em uma roda de
+ * cfg_TEMPORIZADOR_RAIAS raias, pela marca de tempo em que vencem. A marca de tempo 
+ * so verifica se a raia atual tem algum temporizador e, se tiver, acorda a tarefa dos 
+ * temporizadores, que percorre a raia e executa as funcoes dos que venceram. Assim uma 
+ * acao periodica nao precisa de uma tarefa (e uma pilha) so para ela */
+
+#define RAIA_MASCARA	(cfg_TEMPORIZADOR_RAIAS - 1)
+
+static temporizador_t *raias[cfg_TEMPORIZADOR_RAIAS];
 
+/* temporizadores retirados da raia que aguardam a execucao das suas funcoes */
+static temporizador_t *temporizadores_vencidos = 0;
+
+/* numero de temporizadores ativos */
+static uint16_t temporizadores_ativos = 0;
+
+/* tarefa dos temporizadores (0 enquanto ela nao iniciou) e ultima marca de tempo
+   cuja raia ela ja percorreu */
+static uint8_t tarefa_dos_temporizadores = 0;
+static tick_t marca_processada = 0;
+
+/* coloca o temporizador no inicio de uma lista. Deve ser chamada com as interrupcoes bloqueadas */
+static void temporizador_insere(temporizador_t **lista, temporizador_t* temporizador)
+{
+	temporizador->lista = lista;
+	temporizador->anterior = 0;
+	temporizador->proximo = *lista;
+	if(*lista != 0)
+	{
+		(*lista)->anterior = temporizador;
+	}
+	*lista = temporizador;
 }
-void ExecutaMarcaDeTempo(void)
+
+/* retira o temporizador da lista em que ele estiver. Deve ser chamada com as interrupcoes bloqueadas */
+static void temporizador_remove(temporizador_t* temporizador)
 {
+	if(temporizador->lista == 0)
+	{
+		return;
+	}
 	
-	uint8_t tarefa = 0;
-		
-	++contador_marcas; /* incrementa contador de marcas de tempo */
+	if(temporizador->anterior != 0)
+	{
+		temporizador->anterior->proximo = temporizador->proximo;
+	}else
+	{
+		*temporizador->lista = temporizador->proximo;
+	}
+	if(temporizador->proximo != 0)
+	{
+		temporizador->proximo->anterior = temporizador->anterior;
+	}
+	temporizador->lista = 0;
+}
+
+/* coloca o temporizador na raia da marca de tempo em que ele vence */
+static void temporizador_agenda(temporizador_t* temporizador, tick_t expira)
+{
+	temporizador->expira = expira;
+	temporizador_insere(&raias[expira & RAIA_MASCARA], temporizador);
+}
+
+/* chamada a cada avanco da contagem de tempo: acorda a tarefa dos temporizadores se
+   a raia atual tem temporizadores ou, no modo sem marca de tempo, se passou mais de uma
+   marca. Deve ser chamada com as interrupcoes bloqueadas */
+NA_RAM static void temporizadores_verifica(tick_t marcas)
+{
+	if(tarefa_dos_temporizadores != 0 && 
+		(raias[contador_marcas & RAIA_MASCARA] != 0 || (marcas > 1 && temporizadores_ativos != 0)))
+	{
+		(void)notificacao_entrega(tarefa_dos_temporizadores, 0, NOTIFICA_INCREMENTA);
+	}
+}
+
+#if cfg_MODO_SEM_MARCA
+/* marcas de tempo ate a proxima raia com temporizadores (ate cfg_TEMPORIZADOR_RAIAS),
+   usado pela tarefa ociosa para nao dormir alem dela */
+static tick_t temporizadores_proximo(void)
+{
+	tick_t marcas;
 	
-	/* laco para decrementar tempo de espera das tarefas 
-	 * e coloca-las na fila de prontas para executar  */	
-	for (tarefa=numero_tarefas;tarefa > 0;tarefa--)
-	{ 
-	  
-		if(TCB[tarefa].tempo_espera > 0 ) /* se esta esperando algum tempo */
-		{	
-			TCB[tarefa].tempo_espera--; /* decrementa tempo de espera */
+	if(temporizadores_ativos == 0)
+	{
+		return (tick_t)~0;
+	}
+	
+	for(marcas = 1; marcas < cfg_TEMPORIZADOR_RAIAS; marcas++)
+	{
+		if(raias[(tick_t)(contador_marcas + marcas) & RAIA_MASCARA] != 0)
+		{
+			break;
+		}
+	}
+	return marcas;
+}
+#endif
+
+/* Tarefa dos temporizadores: deve ser criada com CriaTarefa, com prioridade maior que a
+ * das tarefas que dependem da precisao dos temporizadores. Ela percorre as raias de todas 
+ * as marcas de tempo que passaram desde a ultima vez e executa as funcoes dos temporizadores 
+ * vencidos, fora da regiao atomica. Os periodicos sao reagendados a partir da marca em que
+ * venceram, para nao acumular atraso */
+void tarefa_temporizadores(void)
+{
+	temporizador_t *temporizador, *proximo;
+	uint16_t raia;
+	
+	REG_ATOMICA_INICIO();
+	
+	tarefa_dos_temporizadores = tarefa_atual;
+	
+	/* comeca pela marca atual, e nao pela marca 0, para nao percorrer as raias de todas
+	 * as marcas desde o inicio do sistema. Os temporizadores iniciados antes da tarefa que
+	 * ja venceram vao direto para os vencidos */
+	marca_processada = contador_marcas - 1;
+	for(raia = 0; raia < cfg_TEMPORIZADOR_RAIAS; raia++)
+	{
+		for(temporizador = raias[raia]; temporizador != 0; temporizador = proximo)
+		{
+			proximo = temporizador->proximo;
+			if((tick_t)(marca_processada - temporizador->expira) < ((tick_t)~0 >> 1))
+			{
+				temporizador_remove(temporizador);
+				temporizador_insere(&temporizadores_vencidos, temporizador);
+			}
+		}
+	}
+	
+	REG_ATOMICA_FIM();
+	
+	for(;;)
+	{
+		while(marca_processada != contador_marcas)
+		{
+			REG_ATOMICA_INICIO();
+			
+			marca_processada++;
+			for(temporizador = raias[marca_processada & RAIA_MASCARA]; temporizador != 0; temporizador = proximo)
+			{
+				proximo = temporizador->proximo;
+				if(temporizador->expira == marca_processada)
+				{
+					temporizador_remove(temporizador);
+					temporizador_insere(&temporizadores_vencidos, temporizador);
+				}
+			}
 			
-			if(TCB[tarefa].tempo_espera == 0 )
+			REG_ATOMICA_FIM();
+			
+			for(;;)
 			{
-				/* coloca a tarefa na fila de prontas para executar */	
-				TCB[tarefa].estado = PRONTA;	        				
+				REG_ATOMICA_INICIO();
+				
+				temporizador = temporizadores_vencidos;
+				if(temporizador == 0)
+				{
+					REG_ATOMICA_FIM();
+					break;
+				}
+				
+				temporizador_remove(temporizador);
+				if(temporizador->periodico)
+				{
+					temporizador_agenda(temporizador, marca_processada + temporizador->periodo);
+				}else
+				{
+					temporizadores_ativos--;
+				}
+				
+				REG_ATOMICA_FIM();
+				
+				/* a funcao pode parar ou reiniciar o proprio temporizador */
+				temporizador->funcao(temporizador);
 			}
 		}
-	 }
+		
+		(void)TarefaNotificacaoRecebe(1, ESPERA_INFINITA);
+	}
 }
 
-/* Servicos de semaforos */
-void SemaforoAguarda(semaforo_t* sem)
+/* Inicia o temporizador para vencer daqui a periodo marcas de tempo. Se ja estava
+ * ativo, recomeca a contagem. Pode ser usada dentro de rotinas de interrupcao */
+void TemporizadorInicia(temporizador_t* temporizador)
 {
+	uint32_t estado;
 	
-	REG_ATOMICA_INICIO();
+	REG_ATOMICA_SALVA(estado);
 	
-	if(sem->contador > 0)
+	if(temporizador->lista != 0)
 	{
-		sem->contador--;
+		temporizador_remove(temporizador);
 	}else
 	{
-		TCB[tarefa_atual].estado = ESPERA;		/* tarefa colocada na fila de espera */
-		sem->tarefaEsperando = tarefa_atual;   	/* tarefa colocada na espera do semaforo */
-		TROCA_CONTEXTO();						/* solicita troca de contexto */
+		temporizadores_ativos++;
 	}
+	if(temporizador->periodo == 0)
+	{
+		temporizador->periodo = 1;
+	}
+	temporizador_agenda(temporizador, contador_marcas + temporizador->periodo);
 	
-	REG_ATOMICA_FIM();
+	REG_ATOMICA_RESTAURA(estado);
+}
+
+/* Para o temporizador. Pode ser usada dentro de rotinas de interrupcao */
+void TemporizadorPara(temporizador_t* temporizador)
+{
+	uint32_t estado;
+	
+	REG_ATOMICA_SALVA(estado);
+	
+	if(temporizador->lista != 0)
+	{
+		temporizador_remove(temporizador);
+		temporizadores_ativos--;
+	}
+	
+	REG_ATOMICA_RESTAURA(estado);
+}
+
+/* Muda o periodo do temporizador e o (re)inicia com o novo periodo. 
+ * Pode ser usada dentro de rotinas de interrupcao */
+void TemporizadorMudaPeriodo(temporizador_t* temporizador, tick_t periodo)
+{
+	uint32_t estado;
+	
+	REG_ATOMICA_SALVA(estado);
+	temporizador->periodo = periodo;
+	TemporizadorInicia(temporizador);
+	REG_ATOMICA_RESTAURA(estado);
 }
 
+/* Servicos de conjuntos de blocos de memoria */
 
-void SemaforoLibera(semaforo_t* sem)
+/* Aloca um bloco do conjunto em tempo constante. Retorna 0 se nao ha bloco livre.
+ * Pode ser usada dentro de rotinas de interrupcao */
+void* MemoriaAloca(memoria_t* memoria)
 {
-	REG_ATOMICA_INICIO();
+	void *bloco;
+	uint32_t estado;
 	
-	if(sem->tarefaEsperando > 0)
-	{	/* tem alguma tarefa aguardando ? */
-		TCB[sem->tarefaEsperando].estado = PRONTA;		/* tarefa colocada na fila de pronta */
-		sem->tarefaEsperando = 0;						/* tarefa retirada da espera do semaforo */
+	REG_ATOMICA_SALVA(estado);
+	
+	if(memoria->livres != 0)
+	{
+		bloco = memoria->livres;				/* reaproveita um bloco liberado */
+		memoria->livres = *(void**)bloco;
+	}else if(memoria->nunca_usados < memoria->numero_blocos)
+	{
+		bloco = memoria->blocos + (uint32_t)memoria->nunca_usados * memoria->tam_bloco;
+		memoria->nunca_usados++;
 	}else
 	{
-		sem->contador++;
+		bloco = 0;
+		memoria->falhas++;
 	}
-	TROCA_CONTEXTO();
 	
-	REG_ATOMICA_FIM();
+	if(bloco != 0 && ++memoria->usados > memoria->usados_max)
+	{
+		memoria->usados_max = memoria->usados;
+	}
+	
+	REG_ATOMICA_RESTAURA(estado);
+	
+	return bloco;
+}
+
+/* Devolve o bloco ao conjunto em tempo constante. Sao ignorados, e contados em 
+ * liberacoes_invalidas, os ponteiros que nao sao o inicio de um bloco ja entregue pelo
+ * conjunto e as liberacoes duplas que podem ser vistas sem percorrer a lista de livres:
+ * sem nenhum bloco alocado ou do mesmo bloco que acabou de ser liberado.
+ * Pode ser usada dentro de rotinas de interrupcao */
+void MemoriaLibera(memoria_t* memoria, void* bloco)
+{
+	uint32_t estado;
+	uint32_t deslocamento;
+	uint8_t valido = 0;
+	
+	REG_ATOMICA_SALVA(estado);
+	
+	if((uint8_t*)bloco >= memoria->blocos)
+	{
+		deslocamento = (uint32_t)((uint8_t*)bloco - memoria->blocos);
+		valido = (deslocamento % memoria->tam_bloco == 0) &&
+			(deslocamento / memoria->tam_bloco < memoria->nunca_usados) &&
+			(memoria->usados != 0) && (bloco != memoria->livres);
+	}
+	
+	if(valido)
+	{
+		*(void**)bloco = memoria->livres;
+		memoria->livres = bloco;
+		memoria->usados--;
+	}else
+	{
+		memoria->liberacoes_invalidas++;
+	}
+	
+	REG_ATOMICA_RESTAURA(estado);
+}
+
+#if cfg_RASTRO
+/* Grava um evento no rastro, para uso da aplicacao e das rotinas de interrupcao
+ * (RASTRO_ISR_INICIO e RASTRO_ISR_FIM) */
+void RastroEvento(uint8_t evento, uint16_t dado)
+{
+	rastro_grava(evento, tarefa_atual, dado);
+}
+#endif
+
+#if cfg_PERFIL
+perfil_t Perfil = {PERFIL_ASSINATURA, cfg_PERFIL_AMOSTRAS, 0, 0, {0}};
+
+/* Guarda uma amostra do perfilador, chamada pela interrupcao da marca de tempo com o PC 
+ * do codigo interrompido. Nao precisa de regiao atomica, pois so e chamada dali */
+void PerfilAmostra(uint32_t pc)
+{
+	uint32_t registro = ((uint32_t)tarefa_atual << 24) | (pc & PERFIL_PC_MASCARA);
+	
+	if(pc >= PERFIL_INICIO_RAM)
+	{
+		registro |= PERFIL_PC_RAM;
+	}
+	Perfil.registros[Perfil.indice] = registro;
+	Perfil.indice = (Perfil.indice + 1) & (cfg_PERFIL_AMOSTRAS - 1);
+	Perfil.amostras++;
 }
+#endif
@@ -14,11 +14,117 @@
 /******************************************************************/
 /* macros de configuracao */
 
-/* numero de tarefas */
+/* numero de tarefas (incluindo a tarefa ociosa, ate 255, pode ser definido na linha de
+   comando do compilador) */
+#ifndef NUMERO_DE_TAREFAS
 #define NUMERO_DE_TAREFAS	3
+#endif
 
-/* numero de prioridades/tarefas */
+/* maior prioridade (ate 255, pode ser definido na linha de comando do compilador) */
+#ifndef PRIORIDADE_MAXIMA
 #define PRIORIDADE_MAXIMA   4
+#endif
+
+/* os identificadores das tarefas e as prioridades sao de 8 bits, e o identificador 0 e
+   reservado (nenhuma tarefa) */
+#if NUMERO_DE_TAREFAS < 1 || NUMERO_DE_TAREFAS > 255
+#error "NUMERO_DE_TAREFAS deve ser de 1 a 255"
+#endif
+#if PRIORIDADE_MAXIMA > 255
+#error "PRIORIDADE_MAXIMA deve ser no maximo 255"
+#endif
+
+/* numero de bytes do mapa de bits das prioridades prontas */
+#define NUMERO_GRUPOS_PRIORIDADE	((PRIORIDADE_MAXIMA >> 3) + 1)
+
+/* modo preemptivo: a marca de tempo so troca o contexto quando fica pronta uma tarefa
+   de maior prioridade que a atual ou quando termina a fatia de tempo (0 = cooperativo) */
+#ifndef cfg_PREEMPTIVO
+#define cfg_PREEMPTIVO		1
+#endif
+
+/* fatia de tempo, em marcas de tempo, de cada tarefa quando ha varias tarefas 
+   prontas com a mesma prioridade (0 desabilita o round-robin, que so existe no modo preemptivo) */
+#ifndef cfg_FATIA_TEMPO
+#define cfg_FATIA_TEMPO		10
+#endif
+
+/* modo sem marca de tempo (tickless): quando so a tarefa ociosa esta pronta, 
+   ela desliga a marca de tempo e dorme ate o proximo atraso (1 habilita) */
+#ifndef cfg_MODO_SEM_MARCA
+#define cfg_MODO_SEM_MARCA	0
+#endif
+
+/* numero de raias da roda de temporizadores de software (potencia de 2). Cada raia
+   guarda os temporizadores que vencem nas marcas de tempo com o mesmo resto da divisao
+   pelo numero de raias: mais raias gastam mais RAM e deixam as raias mais curtas */
+#ifndef cfg_TEMPORIZADOR_RAIAS
+#define cfg_TEMPORIZADOR_RAIAS	16
+#endif
+
+/* medida do tempo de execucao de cada tarefa com um contador livre de alta resolucao 
+   (CONTADOR_TEMPO_HZ, definido no porte), lido a cada troca de contexto (1 habilita) */
+#ifndef cfg_TEMPO_DE_EXECUCAO
+#define cfg_TEMPO_DE_EXECUCAO	0
+#endif
+
+/* janela, em marcas de tempo, da media da carga da CPU */
+#ifndef cfg_JANELA_CARGA
+#define cfg_JANELA_CARGA	1000
+#endif
+
+/* registro (rastro) das trocas de contexto, semaforos, marcas de tempo e interrupcoes
+   em um buffer circular na RAM, para ver o escalonamento depois (1 habilita) */
+#ifndef cfg_RASTRO
+#define cfg_RASTRO			0
+#endif
+
+/* numero de registros do rastro (potencia de 2), 8 bytes cada */
+#ifndef cfg_RASTRO_TAMANHO
+#define cfg_RASTRO_TAMANHO	256
+#endif
+
+/* perfilador estatistico: a cada marca de tempo guarda o PC interrompido e a tarefa
+   atual em um buffer circular, para o perfil por funcao de cada tarefa (1 habilita) */
+#ifndef cfg_PERFIL
+#define cfg_PERFIL			0
+#endif
+
+/* numero de amostras do perfilador (potencia de 2), 4 bytes cada */
+#ifndef cfg_PERFIL_AMOSTRAS
+#define cfg_PERFIL_AMOSTRAS	1024
+#endif
+
+/* medida da latencia entre a interrupcao (ou a liberacao do objeto) e a volta da tarefa
+   que ela acordou, em histogramas com faixas em potencias de 2 (1 habilita) */
+#ifndef cfg_LATENCIA
+#define cfg_LATENCIA		0
+#endif
+
+/* funcoes mais usadas do sistema (troca de contexto, marca de tempo, escalonador, listas
+   de tarefas e semaforos) copiadas para a SRAM na partida e executadas de la, sem os estados 
+   de espera da flash (1 habilita). O porte define como (FUNCAO_NA_RAM e DADOS_NA_RAM) */
+#ifndef cfg_FUNCOES_NA_RAM
+#define cfg_FUNCOES_NA_RAM	0
+#endif
+
+/* tabela de vetores de interrupcao copiada para a SRAM e apontada pelo VTOR (1 habilita) */
+#ifndef cfg_VETORES_NA_RAM
+#define cfg_VETORES_NA_RAM	0
+#endif
+
+/* verificacao das pilhas: as pilhas sao preenchidas com PADRAO_PILHA na criacao, 
+   a troca de contexto verifica se a ultima palavra da pilha foi sobrescrita (estouro)
+   e a tarefa ociosa mede a parte nunca usada de cada pilha (1 habilita) */
+#ifndef cfg_VERIFICA_PILHA
+#define cfg_VERIFICA_PILHA	1
+#endif
+
+/* valor usado para preencher as pilhas */
+#define PADRAO_PILHA		0xA5A5A5A5ul
+
+/* numero minimo de marcas de tempo ociosas para desligar a marca de tempo */
+#define cfg_OCIOSO_MINIMO	2
 
 /* frequencia de clock da CPU */
 #define cfg_CPU_CLOCK_HZ 	48000000
@@ -26,30 +132,110 @@
 /* frequencia da marca de tempo do sistema multitarefas */
 #define cfg_MARCA_TEMPO_HZ  1000
 
+#if cfg_FUNCOES_NA_RAM
+#define NA_RAM				FUNCAO_NA_RAM
+#define TABELA_NA_RAM		DADOS_NA_RAM
+#else
+#define NA_RAM
+#define TABELA_NA_RAM
+#endif
+
 typedef  void (*tarefa_t)(void);
-typedef enum {PRONTA, ESPERA} estado_tarefa_t;
+typedef enum {PRONTA, ESPERA, EXCLUIDA, LIVRE} estado_tarefa_t;
 typedef uint8_t	  prioridade_t;
 typedef uint16_t  tick_t;
 
+/* resultado dos servicos que podem esperar por um tempo limitado */
+typedef enum {SUCESSO, TEMPO_ESGOTADO, FALHA} resultado_t;
+
+/* estado da notificacao direta de uma tarefa */
+typedef enum {NOTIFICACAO_NENHUMA, NOTIFICACAO_PENDENTE, NOTIFICACAO_AGUARDANDO} estado_notificacao_t;
+
+/* acao sobre o valor da notificacao de uma tarefa */
+typedef enum 
+{
+	NOTIFICA_SEM_VALOR,			///< apenas notifica, sem mudar o valor
+	NOTIFICA_LIGA_BITS,			///< liga os bits do valor na notificacao
+	NOTIFICA_INCREMENTA,		///< incrementa a notificacao (uso como semaforo contador)
+	NOTIFICA_SOBRESCREVE,		///< substitui a notificacao pelo valor
+	NOTIFICA_SEM_SOBRESCREVER	///< substitui apenas se a notificacao anterior ja foi recebida
+} acao_notificacao_t;
+
+/* tempos de espera especiais dos servicos com tempo limite */
+#define NAO_ESPERA			((tick_t)0)
+#define ESPERA_INFINITA		((tick_t)~0)
+
+/* lista de tarefas esperando um objeto do kernel (semaforo, etc.), guarda a 
+   primeira tarefa da lista (0 = vazia). Os nos da lista sao Tarefas.proxima e Tarefas.anterior */
+typedef uint8_t	  lista_espera_t;
+
+struct mutex_s;
+struct memoria_s;
+
 /**
 * \struct tcb_t
-* Estrutura de controle de tarefas
+* Estrutura de controle de tarefas: campos usados pelos servicos e pela troca de contexto.
+* Os campos percorridos pelo escalonador e pela marca de tempo ficam em tarefas_t. Os campos
+* estao em ordem de tamanho para nao haver enchimento entre eles
 */
 
 typedef struct
 {
 	const char		*nome;
 	stackptr_t 	stack_pointer;
-	estado_tarefa_t estado;
-	prioridade_t 	prioridade;
-	uint16_t		tempo_espera;
+	stackptr_t		pilha;			///< inicio da memoria da pilha
+	struct memoria_s *memoria_pilha;///< conjunto de blocos de onde a pilha foi alocada (0 = pilha estatica)
+	lista_espera_t	*espera_em;		///< lista de espera em que a tarefa esta (0 = nenhuma)
+	struct mutex_s	*mutexes;		///< mutexes travados pela tarefa
+	struct mutex_s	*mutex_esperado;///< mutex que a tarefa espera (0 = nenhum), para a heranca em cadeia
+	void			*mensagem;		///< mensagem a enviar ou receber enquanto espera uma fila
+	uint32_t		tempo_execucao;	///< tempo total de execucao, em contagens de CONTADOR_TEMPO_HZ
+	uint32_t		eventos;		///< eventos aguardados e, ao acordar, eventos recebidos
+	uint32_t		notificacao;	///< valor da notificacao direta para a tarefa
+#if cfg_LATENCIA
+	uint32_t		latencia_libera;///< instante em que a tarefa foi acordada
+	uint32_t		latencia_isr;	///< instante do inicio da interrupcao que acordou a tarefa
+#endif
+	uint16_t		tam_pilha;		///< tamanho da pilha, em palavras de 32 bits
+	uint16_t		pilha_livre;	///< menor numero de palavras da pilha que nunca foram usadas
+	prioridade_t 	prioridade_base;///< prioridade definida na criacao da tarefa
+	uint8_t			opcoes_eventos;	///< opcoes da espera por eventos
+	uint8_t			estado_notificacao; ///< estado da notificacao (estado_notificacao_t)
+	uint8_t			resultado;		///< resultado da ultima espera (resultado_t)
+#if cfg_LATENCIA
+	uint8_t			latencia_marcas;///< quais instantes acima sao validos
+#endif
 }tcb_t;
 
+/**
+* \struct tarefas_t
+* Campos das tarefas usados pelo escalonador e pela marca de tempo, um vetor por campo e
+* indexados pelo identificador da tarefa, como o TCB. As listas de prontas, de atrasos e
+* de espera sao percorridas lendo so estes vetores, que ficam juntos em poucas linhas de
+* memoria, sem passar pelo resto do TCB de cada tarefa
+*/
+
+typedef struct
+{
+	tick_t			tempo_espera[NUMERO_DE_TAREFAS+1];	///< marcas de tempo a esperar depois da tarefa anterior na lista de atrasos
+	uint8_t			estado[NUMERO_DE_TAREFAS+1];		///< estado_tarefa_t
+	prioridade_t 	prioridade[NUMERO_DE_TAREFAS+1];	///< prioridade atual (pode ter sido herdada por um mutex)
+	uint8_t			proxima[NUMERO_DE_TAREFAS+1];		///< proxima tarefa na lista de prontas da mesma prioridade ou na lista de espera
+	uint8_t			anterior[NUMERO_DE_TAREFAS+1];		///< tarefa anterior na lista de prontas da mesma prioridade ou na lista de espera
+	uint8_t			proxima_espera[NUMERO_DE_TAREFAS+1];	///< proxima tarefa na lista de atrasos
+	uint8_t			anterior_espera[NUMERO_DE_TAREFAS+1];	///< tarefa anterior na lista de atrasos
+} tarefas_t;
+
+/* memoria do sistema para cada tarefa, sem a pilha: TCB e campos em tarefas_t */
+#define RAM_POR_TAREFA		(sizeof(tcb_t) + sizeof(tarefas_t) / (NUMERO_DE_TAREFAS+1))
+
 extern  uint8_t		tarefa_atual;
 extern  uint8_t		proxima_tarefa;
 extern  tcb_t		TCB[NUMERO_DE_TAREFAS+1];
-extern  stackptr_t	ponteiro_de_pilha;
-extern  prioridade_t Prioridades[PRIORIDADE_MAXIMA+1];
+extern  tarefas_t	Tarefas;
+extern  uint8_t		Prioridades[PRIORIDADE_MAXIMA+1];
+extern  uint32_t	contador_trocas;
+extern  uint32_t	contador_trocas_evitadas;
 
 /**
 * \struct semaforo_t
@@ -58,25 +244,309 @@ extern  prioridade_t Prioridades[PRIORIDADE_MAXIMA+1];
 
 typedef struct 
 {
-	uint8_t     contador;            ///< Contador do semaforo
-	uint8_t 	tarefaEsperando;        ///< Tarefa esperando
+	uint8_t     	contador;		///< Contador do semaforo
+	lista_espera_t 	espera;			///< Tarefas esperando, em ordem de prioridade
 } semaforo_t;
 
+/**
+* \struct mutex_t
+* Estrutura de controle do mutex (semaforo binario com dono e heranca de prioridade)
+*/
+
+typedef struct mutex_s
+{
+	uint8_t			dono;			///< Tarefa que travou o mutex (0 = livre)
+	uint8_t			recursao;		///< Numero de vezes que o dono travou o mutex
+	lista_espera_t	espera;			///< Tarefas esperando, em ordem de prioridade
+	struct mutex_s	*proximo;		///< Proximo mutex travado pelo mesmo dono
+	tick_t			bloqueio_max;	///< Maior tempo (em marcas) que uma tarefa esperou pelo mutex
+} mutex_t;
+
+/**
+* \struct fila_t
+* Estrutura de controle da fila de mensagens. A memoria das mensagens e alocada 
+* estaticamente com FILA_DECLARA. Para mensagens grandes, use uma fila de ponteiros
+* (FILA_DE_PONTEIROS_DECLARA) para que so o ponteiro seja copiado
+*/
+
+typedef struct
+{
+	uint8_t			*mensagens;		///< Memoria das mensagens
+	uint8_t			tam_mensagem;	///< Tamanho de cada mensagem, em bytes
+	uint8_t			capacidade;		///< Numero maximo de mensagens
+	uint8_t			quantidade;		///< Numero de mensagens na fila
+	uint8_t			inicio;			///< Posicao da mensagem mais antiga
+	lista_espera_t	espera_envio;	///< Tarefas esperando espaco para enviar, em ordem de prioridade
+	lista_espera_t	espera_recepcao;///< Tarefas esperando mensagens, em ordem de prioridade
+} fila_t;
+
+/* declara uma fila de mensagens do tipo tipo, com espaco para capacidade mensagens.
+   O tamanho da mensagem e a capacidade sao guardados em 8 bits: de 1 a 255 */
+#define FILA_DECLARA(nome, tipo, capacidade)											\
+	_Static_assert(sizeof(tipo) <= 255, "FILA_DECLARA: mensagem maior que 255 bytes");	\
+	_Static_assert((capacidade) >= 1 && (capacidade) <= 255, "FILA_DECLARA: capacidade deve ser de 1 a 255");	\
+	static uint8_t nome##_mensagens[(capacidade) * sizeof(tipo)] __attribute__((aligned(4)));	\
+	fila_t nome = {nome##_mensagens, sizeof(tipo), (capacidade), 0, 0, 0, 0}
+
+/* declara uma fila que passa apenas ponteiros para as mensagens, sem copia-las */
+#define FILA_DE_PONTEIROS_DECLARA(nome, capacidade)		FILA_DECLARA(nome, void*, capacidade)
+
 
 void tarefa_ociosa(void);
 uint8_t escalonador(void);
 
-void TrocaContextoDasTarefas(void);
+stackptr_t TrocaContextoDasTarefas(stackptr_t sp);
 uint32_t * CriaContexto(tarefa_t endereco_tarefa, uint32_t* ptr_pilha);
-void CriaTarefa(tarefa_t p, const char * nome, stackptr_t pilha, uint16_t tamanho, prioridade_t prioridade);
+uint8_t CriaTarefa(tarefa_t p, const char * nome, stackptr_t pilha, uint16_t tamanho, prioridade_t prioridade);
 void IniciaMultitarefas(void);
 void ConfiguraMarcaTempo(void);
-void ExecutaMarcaDeTempo(void);
+uint8_t ExecutaMarcaDeTempo(void);
+tick_t DormeSemMarcaDeTempo(tick_t qtas_marcas);
 
 void TarefaSuspende(uint8_t id_tarefa);
 void TarefaContinua(uint8_t id_tarefa);
 void TarefaEspera(tick_t qtas_marcas);		
+resultado_t TarefaExclui(uint8_t id_tarefa);
+void TarefaTermina(void);
+uint16_t TarefaPilhaLivre(uint8_t id_tarefa);
+void TarefaEstouroPilha(uint8_t id_tarefa);
+uint32_t TarefaTempoExecucao(uint8_t id_tarefa);
+uint16_t CargaCPU(void);
+
+resultado_t TarefaNotifica(uint8_t id_tarefa, uint32_t valor, acao_notificacao_t acao);
+resultado_t TarefaNotificaDaISR(uint8_t id_tarefa, uint32_t valor, acao_notificacao_t acao);
+uint32_t TarefaNotificacaoRecebe(uint8_t zera, tick_t tempo_limite);
+resultado_t TarefaNotificacaoAguarda(uint32_t limpa_entrada, uint32_t limpa_saida, uint32_t* valor, tick_t tempo_limite);
+#define TarefaNotificaLibera(id_tarefa)			TarefaNotifica((id_tarefa), 0, NOTIFICA_INCREMENTA)
+#define TarefaNotificaLiberaDaISR(id_tarefa)	TarefaNotificaDaISR((id_tarefa), 0, NOTIFICA_INCREMENTA)
 
-void SemaforoAguarda(semaforo_t* sem);
+resultado_t SemaforoAguardaTempo(semaforo_t* sem, tick_t tempo_limite);
 void SemaforoLibera(semaforo_t* sem);
+#define SemaforoAguarda(sem)		((void)SemaforoAguardaTempo((sem), ESPERA_INFINITA))
+
+resultado_t MutexTravaTempo(mutex_t* mutex, tick_t tempo_limite);
+#define MutexTrava(mutex)			((void)MutexTravaTempo((mutex), ESPERA_INFINITA))
+void MutexLibera(mutex_t* mutex);
+
+/**
+* \struct grupo_eventos_t
+* Estrutura de controle do grupo de eventos (32 bits de eventos)
+*/
+
+typedef struct
+{
+	uint32_t		eventos;		///< Eventos ligados
+	lista_espera_t	espera;			///< Tarefas esperando eventos, em ordem de prioridade
+} grupo_eventos_t;
+
+/* opcoes da espera por eventos */
+#define EVENTOS_QUALQUER	0x00	///< acorda com qualquer um dos eventos aguardados
+#define EVENTOS_TODOS		0x01	///< acorda somente com todos os eventos aguardados
+#define EVENTOS_LIMPA		0x02	///< desliga os eventos aguardados ao acordar
+
+resultado_t FilaEnvia(fila_t* fila, const void* mensagem, tick_t tempo_limite);
+resultado_t FilaRecebe(fila_t* fila, void* mensagem, tick_t tempo_limite);
+#define FilaEnviaPonteiro(fila, ponteiro, tempo_limite)		FilaEnvia((fila), &(ponteiro), (tempo_limite))
+#define FilaRecebePonteiro(fila, ponteiro, tempo_limite)	FilaRecebe((fila), &(ponteiro), (tempo_limite))
+
+resultado_t EventosAguarda(grupo_eventos_t* grupo, uint32_t aguardados, uint8_t opcoes, uint32_t* eventos, tick_t tempo_limite);
+void EventosSinaliza(grupo_eventos_t* grupo, uint32_t eventos);
+void EventosSinalizaDaISR(grupo_eventos_t* grupo, uint32_t eventos);
+void EventosLimpa(grupo_eventos_t* grupo, uint32_t eventos);
+
+/**
+* \struct temporizador_t
+* Estrutura de controle do temporizador de software. A funcao do temporizador e
+* executada pela tarefa dos temporizadores (tarefa_temporizadores), e nao na interrupcao
+* da marca de tempo, por isso pode usar os servicos do sistema, mas nao deve bloquear
+*/
+
+typedef struct temporizador_s temporizador_t;
+typedef void (*temporizador_funcao_t)(temporizador_t* temporizador);
+
+struct temporizador_s
+{
+	temporizador_funcao_t	funcao;		///< Funcao executada quando o temporizador vence
+	void					*argumento;	///< Argumento livre para a funcao
+	tick_t					periodo;	///< Periodo (ou atraso, se nao for periodico) em marcas
+	uint8_t					periodico;	///< 1 = reinicia sozinho ao vencer, 0 = vence uma vez
+	tick_t					expira;		///< Marca de tempo em que vence
+	temporizador_t			**lista;	///< Raia ou lista em que esta (0 = parado)
+	temporizador_t			*proximo;	///< Proximo temporizador da mesma lista
+	temporizador_t			*anterior;	///< Temporizador anterior da mesma lista
+};
+
+/* declara um temporizador parado */
+#define TEMPORIZADOR_DECLARA(nome, funcao, argumento, periodo, periodico)	\
+	temporizador_t nome = {(funcao), (argumento), (periodo), (periodico), 0, 0, 0, 0}
+
+void tarefa_temporizadores(void);
+void TemporizadorInicia(temporizador_t* temporizador);
+void TemporizadorPara(temporizador_t* temporizador);
+void TemporizadorMudaPeriodo(temporizador_t* temporizador, tick_t periodo);
+#define TemporizadorReinicia(temporizador)	TemporizadorInicia(temporizador)
+#define TemporizadorAtivo(temporizador)		((temporizador)->lista != 0)
+
+/**
+* \struct memoria_t
+* Estrutura de controle de um conjunto (pool) de blocos de memoria de tamanho fixo.
+* Alocar e liberar levam tempo constante e nao fragmentam a memoria. Os blocos nunca
+* usados sao entregues em sequencia e os liberados voltam para uma lista de livres, 
+* encadeada pela primeira palavra de cada bloco, por isso nao e preciso inicializar o conjunto
+*/
+
+typedef struct memoria_s
+{
+	uint8_t			*blocos;		///< Memoria dos blocos
+	void			*livres;		///< Lista de blocos liberados
+	uint16_t		tam_bloco;		///< Tamanho de cada bloco, em bytes (multiplo de 4)
+	uint16_t		numero_blocos;	///< Numero de blocos do conjunto
+	uint16_t		nunca_usados;	///< Primeiro bloco que nunca foi alocado
+	uint16_t		usados;			///< Numero de blocos alocados
+	uint16_t		usados_max;		///< Maior numero de blocos alocados ao mesmo tempo
+	uint16_t		falhas;			///< Numero de alocacoes sem bloco livre
+	uint16_t		liberacoes_invalidas;	///< Numero de liberacoes ignoradas (bloco invalido ou liberado duas vezes)
+} memoria_t;
+
+/* tamanho do bloco arredondado para palavras de 32 bits */
+#define MEMORIA_TAM_BLOCO(tam)		((((tam) + 3) / 4) * 4)
+
+/* declara um conjunto de numero_blocos blocos de tam_bloco bytes */
+#define MEMORIA_DECLARA(nome, tam_bloco, numero_blocos)											\
+	static uint32_t nome##_blocos[(numero_blocos) * (MEMORIA_TAM_BLOCO(tam_bloco) / 4)];		\
+	memoria_t nome = {(uint8_t*)nome##_blocos, 0, MEMORIA_TAM_BLOCO(tam_bloco), (numero_blocos), 0, 0, 0, 0, 0}
+
+void* MemoriaAloca(memoria_t* memoria);
+void MemoriaLibera(memoria_t* memoria, void* bloco);
+
+uint8_t CriaTarefaDinamica(tarefa_t p, const char * nome, memoria_t* pilhas, prioridade_t prioridade);
+
+/**
+* \struct rastro_t
+* Rastro do escalonamento: buffer circular de registros de 8 bytes. Para analisar,
+* copiar a variavel Rastro inteira da RAM (p. ex. no gdb: dump binary value rastro.bin Rastro)
+* e converter com rtos/tools/rastro2json. O campo tempo de cada registro e a leitura do
+* contador de tempo (cfg_TEMPO_DE_EXECUCAO) ou, sem ele, a marca de tempo nos 16 bits
+* mais altos e os ciclos do SysTick dentro da marca nos 16 bits mais baixos
+*/
+
+/* eventos do rastro */
+typedef enum
+{
+	RASTRO_ENTRA = 1,			///< tarefa passou a executar
+	RASTRO_SAI,					///< tarefa deixou de executar
+	RASTRO_MARCA,				///< marca de tempo (dado = contador de marcas)
+	RASTRO_SEMAFORO_LIBERA,		///< semaforo liberado (dado = endereco do semaforo)
+	RASTRO_SEMAFORO_AGUARDA,	///< semaforo recebido sem esperar (dado = endereco do semaforo)
+	RASTRO_SEMAFORO_BLOQUEIA,	///< tarefa bloqueou esperando o semaforo (dado = endereco do semaforo)
+	RASTRO_ISR_ENTRA,			///< inicio de interrupcao (dado = numero da interrupcao)
+	RASTRO_ISR_SAI				///< fim de interrupcao (dado = numero da interrupcao)
+} evento_rastro_t;
+
+typedef struct
+{
+	uint32_t		tempo;			///< instante do evento
+	uint8_t			evento;			///< evento (evento_rastro_t)
+	uint8_t			tarefa;			///< tarefa atual ou tarefa que entra/sai
+	uint16_t		dado;			///< dado do evento
+} registro_rastro_t;
+
+#define RASTRO_ASSINATURA	0x52545352ul	///< "RSTR" em little-endian
+
+typedef struct
+{
+	uint32_t			assinatura;		///< RASTRO_ASSINATURA
+	uint32_t			freq_hz;		///< frequencia da contagem do campo tempo
+	uint32_t			ciclos_marca;	///< ciclos por marca de tempo (0 = tempo e o contador livre)
+	uint16_t			tamanho;		///< numero de registros do buffer
+	uint16_t			indice;			///< proximo registro a ser escrito
+	uint32_t			gravados;		///< total de registros gravados (se > tamanho, o buffer deu a volta)
+	registro_rastro_t	registros[cfg_RASTRO_TAMANHO];
+} rastro_t;
+
+#if cfg_RASTRO
+extern rastro_t Rastro;
+void RastroEvento(uint8_t evento, uint16_t dado);
+#define RASTRO_ISR_INICIO(irq)		RastroEvento(RASTRO_ISR_ENTRA, (irq))
+#define RASTRO_ISR_FIM(irq)			RastroEvento(RASTRO_ISR_SAI, (irq))
+#else
+#define RASTRO_ISR_INICIO(irq)
+#define RASTRO_ISR_FIM(irq)
+#endif
+
+/**
+* \struct perfil_t
+* Amostras do perfilador estatistico. Cada amostra guarda a tarefa atual nos 8 bits
+* mais altos e o PC interrompido nos 24 bits mais baixos: os 23 bits mais baixos do PC
+* e, no bit 23, se o PC estava na SRAM (funcoes em .ramfunc, cfg_FUNCOES_NA_RAM), que 
+* comeca em PERFIL_INICIO_RAM. Para analisar, copiar a 
+* variavel Perfil da RAM (p. ex. no gdb: dump binary value perfil.bin Perfil) e usar 
+* rtos/tools/perfil com o ELF do projeto. As amostras sao feitas na marca de tempo,
+* entao o codigo que executa sempre logo apos a marca aparece menos do que executa
+*/
+
+#define PERFIL_ASSINATURA	0x4C465250ul	///< "PRFL" em little-endian
+#define PERFIL_PC_MASCARA	0x007FFFFFul	///< bits do PC guardados (flash e SRAM ate 8 MB)
+#define PERFIL_PC_RAM		0x00800000ul	///< o PC estava na SRAM
+#define PERFIL_INICIO_RAM	0x20000000ul	///< inicio da SRAM no Cortex-M
+
+typedef struct
+{
+	uint32_t		assinatura;		///< PERFIL_ASSINATURA
+	uint16_t		tamanho;		///< numero de amostras do buffer
+	uint16_t		indice;			///< proxima amostra a ser escrita
+	uint32_t		amostras;		///< total de amostras feitas (se > tamanho, o buffer deu a volta)
+	uint32_t		registros[cfg_PERFIL_AMOSTRAS];
+} perfil_t;
+
+#if cfg_PERFIL
+extern perfil_t Perfil;
+void PerfilAmostra(uint32_t pc);
+#endif
+
+/**
+* \struct latencia_t
+* Histogramas da latencia para acordar tarefas, um por caminho (servico em que a tarefa
+* esperava). A faixa n conta as latencias de 2^n a 2^(n+1)-1 contagens de freq_hz (a faixa
+* 0 conta tambem a latencia 0 e a ultima faixa conta todas as maiores). O inicio e a
+* interrupcao marcada com LATENCIA_ISR_INICIO ou a liberacao do objeto, e o fim e a primeira
+* instrucao da tarefa depois da troca de contexto. A variavel Latencia pode ser lida pelo 
+* depurador ou enviada pela aplicacao e LatenciaZera comeca uma nova medida
+*/
+
+typedef enum
+{
+	CAMINHO_SEMAFORO,
+	CAMINHO_MUTEX,
+	CAMINHO_FILA,
+	CAMINHO_EVENTOS,
+	CAMINHO_NOTIFICACAO,
+	LATENCIA_CAMINHOS
+} caminho_latencia_t;
+
+#define LATENCIA_FAIXAS		24
+#define LATENCIA_ASSINATURA	0x4E544C52ul	///< "RLTN" em little-endian
+
+typedef struct
+{
+	uint32_t		assinatura;									///< LATENCIA_ASSINATURA
+	uint32_t		freq_hz;									///< frequencia da contagem das latencias
+	uint8_t			caminhos;									///< LATENCIA_CAMINHOS
+	uint8_t			faixas;										///< LATENCIA_FAIXAS
+	uint16_t		reservado;
+	uint32_t		isr_tarefa[LATENCIA_CAMINHOS][LATENCIA_FAIXAS];	///< do inicio da interrupcao ate a tarefa
+	uint32_t		libera_tarefa[LATENCIA_CAMINHOS][LATENCIA_FAIXAS];	///< da liberacao do objeto ate a tarefa
+	uint32_t		isr_tarefa_max[LATENCIA_CAMINHOS];				///< maior latencia desde a interrupcao
+	uint32_t		libera_tarefa_max[LATENCIA_CAMINHOS];			///< maior latencia desde a liberacao
+} latencia_t;
+
+#if cfg_LATENCIA
+extern latencia_t Latencia;
+void LatenciaMarcaISR(void);
+void LatenciaZera(void);
+#define LATENCIA_ISR_INICIO()		LatenciaMarcaISR()
+#else
+#define LATENCIA_ISR_INICIO()
+#endif
+
 #endif /* MULTITAREFAS_H_ */
\ No newline at end of file
@@ -0,0 +1,15 @@
+/*
+ * asf.h
+ *
+ * O rtos.h inclui o ASF da Atmel, que nao existe no Linux: este arquivo so inclui
+ * os cabecalhos da biblioteca C usados pelo sistema multitarefas.
+ */
+
+#ifndef ASF_H
+#define ASF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#endif /* ASF_H */
@@ -0,0 +1,208 @@
+/*
+ * cpu_port.c
+ *
+ * Porte do sistema multitarefas para Linux: troca de contexto com ucontext e
+ * marca de tempo com SIGALRM.
+ */
+
+#include <asf.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <sys/time.h>
+#include <time.h>
+#include "cpu-port.h"
+#include "rtos.h"
+
+/* contexto de uma tarefa, guardado no topo da sua pilha */
+typedef struct
+{
+	ucontext_t		uc;
+	tarefa_t		tarefa;
+} contexto_t;
+
+volatile unsigned long systick_carga = (cfg_CPU_CLOCK_HZ / cfg_MARCA_TEMPO_HZ) - 1;
+volatile uint8_t em_interrupcao = 0;
+volatile uint8_t troca_pendente = 0;
+
+static contexto_t *contexto_atual;
+static sigset_t mascara_marca;
+static uint64_t inicio_marca_ns;
+
+static uint64_t agora_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+uint32_t LeContadorTempo(void)
+{
+	return (uint32_t)(agora_ns() / (1000000000ull / CONTADOR_TEMPO_HZ));
+}
+
+volatile unsigned long * LeSysTick(void)
+{
+	static volatile unsigned long valor;
+	uint64_t ciclos = ((agora_ns() - inicio_marca_ns) * (cfg_CPU_CLOCK_HZ / 1000000ull)) / 1000ull;
+
+	valor = (ciclos > systick_carga) ? 0 : (systick_carga - (unsigned long)ciclos);
+	return &valor;
+}
+
+/* Troca de contexto (PendSV): deve ser chamada com o SIGALRM bloqueado. O "stack pointer"
+ * passado ao rtos.c e o endereco de uma variavel na pilha da tarefa que guarda o seu
+ * contexto, entao a verificacao de estouro da pilha continua valendo. Retorna quando a
+ * tarefa voltar a executar */
+static void executa_troca(void)
+{
+	contexto_t * volatile quadro = contexto_atual;
+	uint8_t interrupcao = em_interrupcao;
+	stackptr_t sp;
+
+	troca_pendente = 0;
+
+	sp = TrocaContextoDasTarefas((stackptr_t)&quadro);
+
+	/* NULL: a tarefa atual continua */
+	if(sp != NULL)
+	{
+		contexto_atual = *(contexto_t **)sp;
+		swapcontext(&quadro->uc, &contexto_atual->uc);
+	}
+
+	/* a tarefa pode ter sido trocada dentro da marca de tempo */
+	em_interrupcao = interrupcao;
+}
+
+/* primeira funcao de cada tarefa: se a tarefa retornar, ela e excluida */
+static void inicia_tarefa(void)
+{
+	em_interrupcao = 0;
+	contexto_atual->tarefa();
+	TarefaTermina();
+}
+
+/* Cria o contexto da tarefa no topo da pilha. Abaixo dele fica o ponteiro para o
+ * contexto, que e o "stack pointer" guardado no TCB, e abaixo comeca a pilha da
+ * tarefa. O makecontext so usa o fim da regiao da pilha, entao o tamanho passado a
+ * ele e apenas nominal: o limite real e o inicio do vetor da pilha da tarefa */
+stackptr_t CriaContexto(tarefa_t endereco_tarefa, stackptr_t ptr_pilha)
+{
+	uintptr_t topo = ((uintptr_t)ptr_pilha - sizeof(contexto_t)) & ~(uintptr_t)15;
+	contexto_t *contexto = (contexto_t *)topo;
+	contexto_t **quadro = (contexto_t **)(topo - 16);
+
+	*quadro = contexto;
+
+	getcontext(&contexto->uc);
+	contexto->tarefa = endereco_tarefa;
+	contexto->uc.uc_link = NULL;
+	contexto->uc.uc_stack.ss_sp = (char *)quadro - 1024;
+	contexto->uc.uc_stack.ss_size = 1024;
+	sigemptyset(&contexto->uc.uc_sigmask);		/* a tarefa comeca com as interrupcoes habilitadas */
+	makecontext(&contexto->uc, inicia_tarefa, 0);
+
+	return (stackptr_t)quadro;
+}
+
+void IniciaPrimeiraTarefa(stackptr_t sp)
+{
+	sigprocmask(SIG_BLOCK, &mascara_marca, NULL);
+	contexto_atual = *(contexto_t **)sp;
+	setcontext(&contexto_atual->uc);
+}
+
+void RegiaoAtomicaInicio(void)
+{
+	sigprocmask(SIG_BLOCK, &mascara_marca, NULL);
+}
+
+/* Fim da regiao atomica: faz a troca de contexto pendente (como a PendSV, que e atendida
+ * logo que as interrupcoes sao habilitadas). Dentro da marca de tempo nao faz nada: a
+ * troca e feita no fim da marca de tempo */
+void RegiaoAtomicaFim(void)
+{
+	if(em_interrupcao)
+	{
+		return;
+	}
+
+	if(troca_pendente)
+	{
+		sigprocmask(SIG_BLOCK, &mascara_marca, NULL);
+		executa_troca();
+	}
+
+	sigprocmask(SIG_UNBLOCK, &mascara_marca, NULL);
+}
+
+uint32_t RegiaoAtomicaSalva(void)
+{
+	sigset_t anterior;
+
+	sigprocmask(SIG_BLOCK, &mascara_marca, &anterior);
+	return (uint32_t)sigismember(&anterior, SIGALRM);
+}
+
+void RegiaoAtomicaRestaura(uint32_t estado)
+{
+	if(!estado)
+	{
+		RegiaoAtomicaFim();
+	}
+}
+
+/* Codigo dependente de hardware usado para
+   realizar a marca de tempo do sistema multitarefas - sinal SIGALRM */
+static void MarcaDeTempo(int sinal)
+{
+	(void)sinal;
+
+	em_interrupcao = 15;
+	inicio_marca_ns = agora_ns();
+
+#if cfg_PREEMPTIVO
+	/* so pendura a troca se a tarefa atual deve ser trocada */
+	if(ExecutaMarcaDeTempo())
+	{
+		PEDE_TROCA_CONTEXTO();
+	}
+#else
+	ExecutaMarcaDeTempo();
+#endif
+
+	if(troca_pendente)
+	{
+		executa_troca();
+	}
+
+	em_interrupcao = 0;
+}
+
+/* Codigo dependente de hardware usado para
+ * configuracao da marca de tempo do sistema multitarefas */
+void ConfiguraMarcaTempo(void)
+{
+	struct sigaction acao;
+	struct itimerval periodo;
+
+	sigemptyset(&mascara_marca);
+	sigaddset(&mascara_marca, SIGALRM);
+
+	acao.sa_handler = MarcaDeTempo;
+	acao.sa_flags = SA_RESTART;
+	sigemptyset(&acao.sa_mask);
+	sigaction(SIGALRM, &acao, NULL);
+
+	inicio_marca_ns = agora_ns();
+
+	periodo.it_interval.tv_sec = 0;
+	periodo.it_interval.tv_usec = 1000000 / cfg_MARCA_TEMPO_HZ;
+	periodo.it_value = periodo.it_interval;
+	setitimer(ITIMER_REAL, &periodo, NULL);
+}
+
+#if cfg_MODO_SEM_MARCA
+#error "o porte Linux nao tem o modo sem marca de tempo (cfg_MODO_SEM_MARCA = 0)"
+#endif
@@ -0,0 +1,81 @@
+/*
+ * cpu_port.h
+ *
+ * Porte do sistema multitarefas para Linux (x86-64, AArch64 e outros com ucontext),
+ * para simulacao e medidas sem a placa. O rtos.c e o mesmo do as_sam_d21.
+ *
+ * Equivalencias com o Cortex-M:
+ *  - a troca de contexto e feita com swapcontext, e o contexto de cada tarefa fica
+ *    no topo da sua pilha;
+ *  - a marca de tempo (SysTick) e o sinal SIGALRM do setitimer;
+ *  - bloquear as interrupcoes (PRIMASK) e bloquear o SIGALRM com sigprocmask;
+ *  - a PendSV e simulada por uma troca pendente, feita no fim da regiao atomica
+ *    ou no fim da marca de tempo.
+ *
+ * As tarefas executam no mesmo thread e podem ser trocadas a qualquer momento pela
+ * marca de tempo: chamadas da biblioteca C que nao sao reentrantes (printf, malloc)
+ * devem ficar dentro de uma regiao atomica.
+ */
+
+
+#ifndef CPU_PORT_H_
+#define CPU_PORT_H_
+
+#include "stdint.h"
+
+/* o contexto (ucontext_t) fica no topo da pilha e a marca de tempo tambem usa a pilha
+   da tarefa interrompida para o quadro do sinal, entao a pilha minima e bem maior */
+#define TAM_MINIMO_PILHA  (2048)
+
+/* tipo do ponteiro de pilha */
+typedef uint32_t* stackptr_t;
+
+/* no Linux nao ha flash: cfg_FUNCOES_NA_RAM nao muda nada */
+#define FUNCAO_NA_RAM
+#define DADOS_NA_RAM
+
+/* SysTick simulado: o valor e calculado pelo tempo desde a ultima marca de tempo,
+   contando para baixo com o clock cfg_CPU_CLOCK_HZ, como no Cortex-M */
+extern volatile unsigned long systick_carga;
+volatile unsigned long * LeSysTick(void);
+
+#define NVIC_SYSTICK_LOAD       (&systick_carga)
+#define NVIC_SYSTICK_VAL        (LeSysTick())
+
+/* medida do tempo de execucao: relogio CLOCK_MONOTONIC em unidades de 100 ns
+   (volta a zero a cada 7 minutos) */
+#define CONTADOR_TEMPO_HZ				10000000ul
+
+uint32_t LeContadorTempo(void);
+#define LE_CONTADOR_TEMPO()				LeContadorTempo()
+
+/* regioes atomicas: bloqueiam a marca de tempo e, ao terminar, fazem a troca pendente */
+void RegiaoAtomicaInicio(void);
+void RegiaoAtomicaFim(void);
+uint32_t RegiaoAtomicaSalva(void);
+void RegiaoAtomicaRestaura(uint32_t estado);
+
+#define REG_ATOMICA_INICIO()  	  RegiaoAtomicaInicio();
+#define REG_ATOMICA_FIM()  		  RegiaoAtomicaFim();
+
+/* versoes que guardam e restauram o estado anterior das interrupcoes, para uso em
+   rotinas de interrupcao ou dentro de outra regiao atomica */
+#define REG_ATOMICA_SALVA(estado)		(estado) = RegiaoAtomicaSalva();
+#define REG_ATOMICA_RESTAURA(estado)	RegiaoAtomicaRestaura(estado);
+
+/* numero da "excecao" em execucao (15 = SysTick, como o IPSR), 0 nas tarefas */
+extern volatile uint8_t em_interrupcao;
+#define EM_INTERRUPCAO()		(em_interrupcao)
+
+/* a troca pendente faz o papel da PendSV */
+extern volatile uint8_t troca_pendente;
+
+#define TROCA_CONTEXTO()		troca_pendente = 1; RegiaoAtomicaFim();
+#define TrocaContexto()		    TROCA_CONTEXTO()
+#define PEDE_TROCA_CONTEXTO()	troca_pendente = 1		// apenas pendura a troca, para uso em interrupcoes
+
+/* inicia a primeira tarefa (no Cortex-M, pela SVC) */
+void IniciaPrimeiraTarefa(stackptr_t sp);
+#define GERA_INTERRUPCAO_SW(sp)	IniciaPrimeiraTarefa(sp);
+
+#endif /* CPU_PORT_H_ */
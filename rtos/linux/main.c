@@ -0,0 +1,147 @@
+/**
+ * \file
+ *
+ * \brief Exemplo do sistema multitarefas executando como um processo Linux.
+ *
+ * Um produtor e um consumidor trocam mensagens por semaforos, uma tarefa periodica
+ * conta as suas ativacoes e, depois de DURACAO_MS, a tarefa de relatorio mostra as
+ * trocas de contexto, a memoria do sistema por tarefa, o tempo de execucao e o uso da
+ * pilha de cada tarefa e termina o processo.
+ */
+
+#include <asf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "stdint.h"
+#include "rtos.h"
+
+/*
+ * Prototipos das tarefas
+ */
+void tarefa_produtor(void);
+void tarefa_consumidor(void);
+void tarefa_periodica(void);
+void tarefa_relatorio(void);
+
+/*
+ * Configuracao dos tamanhos das pilhas
+ */
+#define TAM_PILHA_PRODUTOR		(TAM_MINIMO_PILHA + 512)
+#define TAM_PILHA_CONSUMIDOR	(TAM_MINIMO_PILHA + 512)
+#define TAM_PILHA_PERIODICA		(TAM_MINIMO_PILHA + 512)
+#define TAM_PILHA_RELATORIO		(TAM_MINIMO_PILHA + 2048)	/* printf */
+#define TAM_PILHA_OCIOSA		(TAM_MINIMO_PILHA + 512)
+
+/*
+ * Pilhas das tarefas
+ */
+uint32_t PILHA_PRODUTOR[TAM_PILHA_PRODUTOR];
+uint32_t PILHA_CONSUMIDOR[TAM_PILHA_CONSUMIDOR];
+uint32_t PILHA_PERIODICA[TAM_PILHA_PERIODICA];
+uint32_t PILHA_RELATORIO[TAM_PILHA_RELATORIO];
+uint32_t PILHA_TAREFA_OCIOSA[TAM_PILHA_OCIOSA];
+
+/* tempo de execucao do exemplo, em marcas de tempo */
+#define DURACAO_MS		2000
+
+#define TAM_BUFFER		8
+
+semaforo_t SemaforoVazio = {TAM_BUFFER, 0};
+semaforo_t SemaforoCheio = {0, 0};
+
+static uint32_t buffer[TAM_BUFFER];
+static volatile uint32_t produzidos = 0, consumidos = 0, ativacoes = 0;
+
+int main(void)
+{
+	/* Criacao das tarefas */
+	/* Parametros: ponteiro, nome, ponteiro da pilha, tamanho da pilha, prioridade da tarefa */
+	CriaTarefa(tarefa_produtor, "Produtor", PILHA_PRODUTOR, TAM_PILHA_PRODUTOR, 1);
+	CriaTarefa(tarefa_consumidor, "Consumidor", PILHA_CONSUMIDOR, TAM_PILHA_CONSUMIDOR, 2);
+	CriaTarefa(tarefa_periodica, "Periodica", PILHA_PERIODICA, TAM_PILHA_PERIODICA, 3);
+	CriaTarefa(tarefa_relatorio, "Relatorio", PILHA_RELATORIO, TAM_PILHA_RELATORIO, PRIORIDADE_MAXIMA);
+
+	/* Cria tarefa ociosa do sistema */
+	CriaTarefa(tarefa_ociosa, "Tarefa ociosa", PILHA_TAREFA_OCIOSA, TAM_PILHA_OCIOSA, 0);
+
+	/* Configura a marca de tempo (SIGALRM) e inicia o escalonador */
+	ConfiguraMarcaTempo();
+	IniciaMultitarefas();
+
+	/* O codigo nao devera alcancar este ponto */
+	return 1;
+}
+
+void tarefa_produtor(void)
+{
+	uint8_t i = 0;
+
+	for(;;)
+	{
+		SemaforoAguarda(&SemaforoVazio);
+		buffer[i] = produzidos++;
+		i = (i + 1) % TAM_BUFFER;
+		SemaforoLibera(&SemaforoCheio);
+	}
+}
+
+void tarefa_consumidor(void)
+{
+	uint8_t f = 0;
+
+	for(;;)
+	{
+		SemaforoAguarda(&SemaforoCheio);
+		if(buffer[f] != consumidos)
+		{
+			REG_ATOMICA_INICIO();
+			printf("erro: mensagem %u fora de ordem\n", (unsigned)buffer[f]);
+			exit(1);
+		}
+		consumidos++;
+		f = (f + 1) % TAM_BUFFER;
+		SemaforoLibera(&SemaforoVazio);
+	}
+}
+
+void tarefa_periodica(void)
+{
+	for(;;)
+	{
+		ativacoes++;
+		TarefaEspera(10);
+	}
+}
+
+void tarefa_relatorio(void)
+{
+	uint16_t id;
+
+	TarefaEspera(DURACAO_MS);
+
+	/* printf nao e reentrante: fica em regiao atomica */
+	REG_ATOMICA_INICIO();
+	printf("mensagens: %u produzidas, %u consumidas\n", (unsigned)produzidos, (unsigned)consumidos);
+	printf("ativacoes da tarefa periodica: %u (esperadas %u)\n", (unsigned)ativacoes, DURACAO_MS / 10);
+	printf("trocas de contexto: %u, evitadas: %u\n", (unsigned)contador_trocas, (unsigned)contador_trocas_evitadas);
+	printf("memoria do sistema por tarefa: %u bytes (%u tarefas: %u bytes)\n", (unsigned)RAM_POR_TAREFA,
+		NUMERO_DE_TAREFAS, (unsigned)(sizeof(TCB) + sizeof(Tarefas)));
+#if cfg_TEMPO_DE_EXECUCAO
+	printf("carga da CPU: %u.%u%%\n", CargaCPU() / 10, CargaCPU() % 10);
+#endif
+	for(id = 1; id <= NUMERO_DE_TAREFAS; id++)
+	{
+		if(Tarefas.estado[id] == LIVRE || TCB[id].nome == NULL)
+		{
+			continue;
+		}
+		printf("%-14s pilha livre %5u de %5u palavras", TCB[id].nome, TarefaPilhaLivre(id), TCB[id].tam_pilha);
+#if cfg_TEMPO_DE_EXECUCAO
+		printf(", tempo %8u us", (unsigned)(TarefaTempoExecucao(id) / (CONTADOR_TEMPO_HZ / 1000000)));
+#endif
+		printf("\n");
+	}
+	fflush(stdout);
+
+	exit((consumidos > 0 && ativacoes > 0) ? 0 : 1);
+}
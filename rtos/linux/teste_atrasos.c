@@ -0,0 +1,98 @@
+/**
+ * \file
+ *
+ * \brief Teste da lista de atrasos: varias tarefas acordando na mesma marca de tempo.
+ *
+ * As tarefas A e B esperam o mesmo tempo e acordam na mesma marca. A volta a esperar
+ * um tempo menor que o da tarefa C, ficando antes dela na lista de atrasos, e B chama
+ * TarefaContinua para si mesma, que tenta retira-la da lista de atrasos (onde ela ja nao
+ * esta). B nao pode mexer nos encadeamentos de A: C e A devem acordar no tempo certo.
+ * Termina o processo com 0 se todas as tarefas acordaram.
+ */
+
+#include <asf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "stdint.h"
+#include "rtos.h"
+
+/*
+ * Prototipos das tarefas
+ */
+void tarefa_a(void);
+void tarefa_b(void);
+void tarefa_c(void);
+void tarefa_verifica(void);
+
+/*
+ * Configuracao dos tamanhos das pilhas
+ */
+#define TAM_PILHA				(TAM_MINIMO_PILHA + 512)
+#define TAM_PILHA_VERIFICA		(TAM_MINIMO_PILHA + 2048)	/* printf */
+
+/*
+ * Pilhas das tarefas
+ */
+uint32_t PILHA_A[TAM_PILHA];
+uint32_t PILHA_B[TAM_PILHA];
+uint32_t PILHA_C[TAM_PILHA];
+uint32_t PILHA_VERIFICA[TAM_PILHA_VERIFICA];
+uint32_t PILHA_TAREFA_OCIOSA[TAM_PILHA];
+
+static uint8_t id_b;
+static volatile uint8_t a_acordou = 0, b_acordou = 0, c_acordou = 0;
+
+int main(void)
+{
+	/* Criacao das tarefas */
+	/* Parametros: ponteiro, nome, ponteiro da pilha, tamanho da pilha, prioridade da tarefa */
+	CriaTarefa(tarefa_verifica, "Verifica", PILHA_VERIFICA, TAM_PILHA_VERIFICA, 4);
+	CriaTarefa(tarefa_a, "A", PILHA_A, TAM_PILHA, 3);
+	id_b = CriaTarefa(tarefa_b, "B", PILHA_B, TAM_PILHA, 2);
+	CriaTarefa(tarefa_c, "C", PILHA_C, TAM_PILHA, 1);
+
+	/* Cria tarefa ociosa do sistema */
+	CriaTarefa(tarefa_ociosa, "Tarefa ociosa", PILHA_TAREFA_OCIOSA, TAM_PILHA, 0);
+
+	/* Configura a marca de tempo (SIGALRM) e inicia o escalonador */
+	ConfiguraMarcaTempo();
+	IniciaMultitarefas();
+
+	/* O codigo nao devera alcancar este ponto */
+	return 1;
+}
+
+void tarefa_a(void)
+{
+	TarefaEspera(5);		/* acorda junto com B */
+	TarefaEspera(20);		/* fica antes de C na lista de atrasos */
+	a_acordou = 1;
+	TarefaSuspende(tarefa_atual);
+}
+
+void tarefa_b(void)
+{
+	TarefaEspera(5);
+	TarefaContinua(id_b);	/* B ja esta pronta: nao deve mudar a lista de atrasos */
+	b_acordou = 1;
+	TarefaSuspende(tarefa_atual);
+}
+
+void tarefa_c(void)
+{
+	TarefaEspera(40);
+	c_acordou = 1;
+	TarefaSuspende(tarefa_atual);
+}
+
+void tarefa_verifica(void)
+{
+	TarefaEspera(200);
+
+	REG_ATOMICA_INICIO();
+	printf("lista de atrasos: A %s, B %s, C %s\n", a_acordou ? "acordou" : "nao acordou",
+		b_acordou ? "acordou" : "nao acordou", c_acordou ? "acordou" : "nao acordou");
+	fflush(stdout);
+
+	exit((a_acordou && b_acordou && c_acordou) ? 0 : 1);
+}
@@ -0,0 +1,116 @@
+/**
+ * \file
+ *
+ * \brief Teste da lista de espera de um semaforo: ordem de prioridade e FIFO.
+ *
+ * Quatro tarefas chegam ao semaforo em marcas de tempo diferentes, fora da ordem de
+ * prioridade: B1 (prioridade 1), A (2), B2 (1) e C (3). Cada SemaforoLibera deve acordar a
+ * de maior prioridade e, entre as de mesma prioridade, a que chegou primeiro: C, A, B1, B2.
+ * Termina o processo com 0 se as tarefas acordaram nesta ordem.
+ */
+
+#include <asf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stdint.h"
+#include "rtos.h"
+
+/*
+ * Prototipos das tarefas
+ */
+void tarefa_b1(void);
+void tarefa_a(void);
+void tarefa_b2(void);
+void tarefa_c(void);
+void tarefa_verifica(void);
+
+/*
+ * Configuracao dos tamanhos das pilhas
+ */
+#define TAM_PILHA				(TAM_MINIMO_PILHA + 512)
+#define TAM_PILHA_VERIFICA		(TAM_MINIMO_PILHA + 2048)	/* printf */
+
+/*
+ * Pilhas das tarefas
+ */
+uint32_t PILHA_B1[TAM_PILHA];
+uint32_t PILHA_A[TAM_PILHA];
+uint32_t PILHA_B2[TAM_PILHA];
+uint32_t PILHA_C[TAM_PILHA];
+uint32_t PILHA_VERIFICA[TAM_PILHA_VERIFICA];
+uint32_t PILHA_TAREFA_OCIOSA[TAM_PILHA];
+
+semaforo_t SemaforoTeste = {0, 0};
+
+/* ordem em que as tarefas acordaram */
+static char ordem[8];
+static uint8_t acordadas = 0;
+
+int main(void)
+{
+	/* Criacao das tarefas */
+	/* Parametros: ponteiro, nome, ponteiro da pilha, tamanho da pilha, prioridade da tarefa */
+	CriaTarefa(tarefa_verifica, "Verifica", PILHA_VERIFICA, TAM_PILHA_VERIFICA, 4);
+	CriaTarefa(tarefa_c, "C", PILHA_C, TAM_PILHA, 3);
+	CriaTarefa(tarefa_a, "A", PILHA_A, TAM_PILHA, 2);
+	CriaTarefa(tarefa_b1, "B1", PILHA_B1, TAM_PILHA, 1);
+	CriaTarefa(tarefa_b2, "B2", PILHA_B2, TAM_PILHA, 1);
+
+	/* Cria tarefa ociosa do sistema */
+	CriaTarefa(tarefa_ociosa, "Tarefa ociosa", PILHA_TAREFA_OCIOSA, TAM_PILHA, 0);
+
+	/* Configura a marca de tempo (SIGALRM) e inicia o escalonador */
+	ConfiguraMarcaTempo();
+	IniciaMultitarefas();
+
+	/* O codigo nao devera alcancar este ponto */
+	return 1;
+}
+
+/* espera o semaforo a partir da marca de tempo chegada e anota que acordou */
+static void espera_e_anota(tick_t chegada, char nome)
+{
+	TarefaEspera(chegada);
+	SemaforoAguarda(&SemaforoTeste);
+	ordem[acordadas++] = nome;
+	TarefaSuspende(tarefa_atual);
+}
+
+void tarefa_b1(void)
+{
+	espera_e_anota(1, '1');
+}
+
+void tarefa_a(void)
+{
+	espera_e_anota(2, 'A');
+}
+
+void tarefa_b2(void)
+{
+	espera_e_anota(3, '2');
+}
+
+void tarefa_c(void)
+{
+	espera_e_anota(4, 'C');
+}
+
+void tarefa_verifica(void)
+{
+	uint8_t i;
+
+	TarefaEspera(10);
+	for(i = 0; i < 4; i++)
+	{
+		SemaforoLibera(&SemaforoTeste);
+	}
+	TarefaEspera(5);
+
+	REG_ATOMICA_INICIO();
+	printf("lista de espera: ordem %s (esperada CA12)\n", ordem);
+	fflush(stdout);
+
+	exit(strcmp(ordem, "CA12") == 0 ? 0 : 1);
+}
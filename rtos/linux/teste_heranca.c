@@ -0,0 +1,115 @@
+/**
+ * \file
+ *
+ * \brief Teste da heranca de prioridade em cadeia e da exclusao de tarefas com mutex.
+ *
+ * A tarefa L trava o mutex M1. A tarefa M trava o mutex M2 e espera M1. A tarefa H 
+ * espera M2: M herda a prioridade de H e, como M espera M1, L tambem herda. Depois a 
+ * tarefa de verificacao tenta excluir L, que tem um mutex travado e nao pode ser excluida,
+ * e exclui H: M e L devem voltar a prioridade de M.
+ * Termina o processo com 0 se as prioridades estao certas em cada passo.
+ */
+
+#include <asf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "stdint.h"
+#include "rtos.h"
+
+/*
+ * Prototipos das tarefas
+ */
+void tarefa_l(void);
+void tarefa_m(void);
+void tarefa_h(void);
+void tarefa_verifica(void);
+
+/*
+ * Configuracao dos tamanhos das pilhas
+ */
+#define TAM_PILHA				(TAM_MINIMO_PILHA + 512)
+#define TAM_PILHA_VERIFICA		(TAM_MINIMO_PILHA + 2048)	/* printf */
+
+/*
+ * Pilhas das tarefas
+ */
+uint32_t PILHA_L[TAM_PILHA];
+uint32_t PILHA_M[TAM_PILHA];
+uint32_t PILHA_H[TAM_PILHA];
+uint32_t PILHA_VERIFICA[TAM_PILHA_VERIFICA];
+uint32_t PILHA_TAREFA_OCIOSA[TAM_PILHA];
+
+mutex_t M1 = {0};
+mutex_t M2 = {0};
+
+static uint8_t id_l, id_m, id_h;
+
+int main(void)
+{
+	/* Criacao das tarefas */
+	/* Parametros: ponteiro, nome, ponteiro da pilha, tamanho da pilha, prioridade da tarefa */
+	CriaTarefa(tarefa_verifica, "Verifica", PILHA_VERIFICA, TAM_PILHA_VERIFICA, 4);
+	id_h = CriaTarefa(tarefa_h, "H", PILHA_H, TAM_PILHA, 3);
+	id_m = CriaTarefa(tarefa_m, "M", PILHA_M, TAM_PILHA, 2);
+	id_l = CriaTarefa(tarefa_l, "L", PILHA_L, TAM_PILHA, 1);
+
+	/* Cria tarefa ociosa do sistema */
+	CriaTarefa(tarefa_ociosa, "Tarefa ociosa", PILHA_TAREFA_OCIOSA, TAM_PILHA, 0);
+
+	/* Configura a marca de tempo (SIGALRM) e inicia o escalonador */
+	ConfiguraMarcaTempo();
+	IniciaMultitarefas();
+
+	/* O codigo nao devera alcancar este ponto */
+	return 1;
+}
+
+void tarefa_l(void)
+{
+	MutexTrava(&M1);
+	TarefaSuspende(tarefa_atual);	/* fica com M1 travado */
+}
+
+void tarefa_m(void)
+{
+	MutexTrava(&M2);
+	TarefaEspera(5);
+	MutexTrava(&M1);				/* espera L */
+	TarefaSuspende(tarefa_atual);
+}
+
+void tarefa_h(void)
+{
+	TarefaEspera(10);
+	MutexTrava(&M2);				/* espera M, que espera L */
+	TarefaSuspende(tarefa_atual);
+}
+
+static void confere(const char *passo, uint8_t certo)
+{
+	REG_ATOMICA_INICIO();
+	printf("heranca: %s: L %u, M %u, %s\n", passo, (unsigned)Tarefas.prioridade[id_l],
+		(unsigned)Tarefas.prioridade[id_m], certo ? "ok" : "errado");
+	fflush(stdout);
+	if(!certo)
+	{
+		exit(1);
+	}
+	REG_ATOMICA_FIM();
+}
+
+void tarefa_verifica(void)
+{
+	TarefaEspera(8);
+	confere("M espera L", Tarefas.prioridade[id_l] == 2 && Tarefas.prioridade[id_m] == 2);
+
+	TarefaEspera(12);
+	confere("H espera M", Tarefas.prioridade[id_l] == 3 && Tarefas.prioridade[id_m] == 3);
+
+	confere("exclui L com M1 travado", TarefaExclui(id_l) == FALHA);
+
+	confere("exclui H", TarefaExclui(id_h) == SUCESSO && Tarefas.prioridade[id_l] == 2 && 
+		Tarefas.prioridade[id_m] == 2);
+
+	exit(0);
+}
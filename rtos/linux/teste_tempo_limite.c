@@ -0,0 +1,131 @@
+/**
+ * \file
+ *
+ * \brief Teste das esperas com tempo limite no semaforo e no mutex.
+ *
+ * A tarefa S1 espera o semaforo por 20 marcas de tempo e S2, de menor prioridade, espera
+ * sem limite. S1 deve voltar com TEMPO_ESGOTADO depois das 20 marcas e sair da lista de
+ * espera, de forma que o SemaforoLibera seguinte acorde S2.
+ * A tarefa L trava o mutex e H espera por ele por 20 marcas: enquanto H espera, L herda a
+ * sua prioridade, e quando o tempo de H esgota L volta a sua prioridade.
+ * Termina o processo com 0 se todos os passos estao certos.
+ */
+
+#include <asf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "stdint.h"
+#include "rtos.h"
+
+/*
+ * Prototipos das tarefas
+ */
+void tarefa_s1(void);
+void tarefa_s2(void);
+void tarefa_l(void);
+void tarefa_h(void);
+void tarefa_verifica(void);
+
+/*
+ * Configuracao dos tamanhos das pilhas
+ */
+#define TAM_PILHA				(TAM_MINIMO_PILHA + 512)
+#define TAM_PILHA_VERIFICA		(TAM_MINIMO_PILHA + 2048)	/* printf */
+
+/*
+ * Pilhas das tarefas
+ */
+uint32_t PILHA_S1[TAM_PILHA];
+uint32_t PILHA_S2[TAM_PILHA];
+uint32_t PILHA_L[TAM_PILHA];
+uint32_t PILHA_H[TAM_PILHA];
+uint32_t PILHA_VERIFICA[TAM_PILHA_VERIFICA];
+uint32_t PILHA_TAREFA_OCIOSA[TAM_PILHA];
+
+semaforo_t SemaforoTeste = {0, 0};
+mutex_t MutexTeste = {0};
+
+/* resultado de cada espera, FALHA enquanto a tarefa nao voltou */
+static volatile resultado_t resultado_s1 = FALHA, resultado_s2 = FALHA, resultado_h = FALHA;
+static uint8_t id_l;
+
+int main(void)
+{
+	/* Criacao das tarefas */
+	/* Parametros: ponteiro, nome, ponteiro da pilha, tamanho da pilha, prioridade da tarefa */
+	CriaTarefa(tarefa_verifica, "Verifica", PILHA_VERIFICA, TAM_PILHA_VERIFICA, 4);
+	CriaTarefa(tarefa_h, "H", PILHA_H, TAM_PILHA, 3);
+	CriaTarefa(tarefa_s1, "S1", PILHA_S1, TAM_PILHA, 2);
+	CriaTarefa(tarefa_s2, "S2", PILHA_S2, TAM_PILHA, 1);
+	id_l = CriaTarefa(tarefa_l, "L", PILHA_L, TAM_PILHA, 1);
+
+	/* Cria tarefa ociosa do sistema */
+	CriaTarefa(tarefa_ociosa, "Tarefa ociosa", PILHA_TAREFA_OCIOSA, TAM_PILHA, 0);
+
+	/* Configura a marca de tempo (SIGALRM) e inicia o escalonador */
+	ConfiguraMarcaTempo();
+	IniciaMultitarefas();
+
+	/* O codigo nao devera alcancar este ponto */
+	return 1;
+}
+
+void tarefa_s1(void)
+{
+	resultado_s1 = SemaforoAguardaTempo(&SemaforoTeste, 20);
+	TarefaSuspende(tarefa_atual);
+}
+
+void tarefa_s2(void)
+{
+	resultado_s2 = SemaforoAguardaTempo(&SemaforoTeste, ESPERA_INFINITA);
+	TarefaSuspende(tarefa_atual);
+}
+
+void tarefa_l(void)
+{
+	MutexTrava(&MutexTeste);
+	TarefaSuspende(tarefa_atual);	/* fica com o mutex travado */
+}
+
+void tarefa_h(void)
+{
+	TarefaEspera(50);				/* L ja travou o mutex */
+	resultado_h = MutexTravaTempo(&MutexTeste, 20);
+	TarefaSuspende(tarefa_atual);
+}
+
+static void confere(const char *passo, uint8_t certo)
+{
+	REG_ATOMICA_INICIO();
+	printf("tempo limite: %s: %s\n", passo, certo ? "ok" : "errado");
+	fflush(stdout);
+	if(!certo)
+	{
+		exit(1);
+	}
+	REG_ATOMICA_FIM();
+}
+
+void tarefa_verifica(void)
+{
+	TarefaEspera(10);
+	confere("semaforo antes do tempo limite", resultado_s1 == FALHA && resultado_s2 == FALHA);
+
+	TarefaEspera(20);
+	confere("semaforo depois do tempo limite", resultado_s1 == TEMPO_ESGOTADO && resultado_s2 == FALHA);
+
+	SemaforoLibera(&SemaforoTeste);
+	TarefaEspera(1);
+	confere("SemaforoLibera acorda S2", resultado_s2 == SUCESSO && SemaforoTeste.contador == 0 &&
+		SemaforoTeste.espera == 0);
+
+	TarefaEspera(30);				/* marca 61: H espera o mutex desde a marca 50 */
+	confere("L herda a prioridade de H", resultado_h == FALHA && Tarefas.prioridade[id_l] == 3);
+
+	TarefaEspera(20);
+	confere("mutex depois do tempo limite", resultado_h == TEMPO_ESGOTADO && 
+		Tarefas.prioridade[id_l] == 1 && MutexTeste.espera == 0);
+
+	exit(0);
+}
@@ -0,0 +1,238 @@
+/*
+ * perfil.c
+ *
+ * Mostra o perfil plano, por tarefa, das amostras do perfilador estatistico do rtos
+ * (variavel Perfil, cfg_PERFIL = 1) copiadas da RAM do microcontrolador. Os PCs sao
+ * associados as funcoes pela tabela de simbolos do ELF do projeto, lida com o nm.
+ *
+ * Compilar:  gcc -O2 -o perfil perfil.c
+ * Usar:      perfil perfil.bin as_d21.elf [nm]
+ *            (nm padrao: arm-none-eabi-nm)
+ *
+ * O arquivo perfil.bin e a copia binaria da variavel Perfil, por exemplo no gdb:
+ *            dump binary value perfil.bin Perfil
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PERFIL_ASSINATURA	0x4C465250ul
+#define TAM_CABECALHO		12		/* assinatura, tamanho, indice, amostras */
+#define PERFIL_PC_MASCARA	0x007FFFFFul	/* como no rtos.h */
+#define PERFIL_PC_RAM		0x00800000ul
+#define PERFIL_INICIO_RAM	0x20000000ul
+#define MASCARA_REGIAO		0xE0000000ul	/* regiao do mapa de memoria do Cortex-M (codigo, SRAM, ...) */
+
+typedef struct
+{
+	uint32_t	endereco;
+	char		*nome;
+} simbolo_t;
+
+typedef struct
+{
+	uint8_t		tarefa;
+	int			simbolo;
+	uint32_t	contagem;
+} linha_t;
+
+static simbolo_t *simbolos;
+static int numero_simbolos;
+
+static uint32_t le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static int compara_simbolos(const void *a, const void *b)
+{
+	uint32_t ea = ((const simbolo_t *)a)->endereco, eb = ((const simbolo_t *)b)->endereco;
+	return (ea > eb) - (ea < eb);
+}
+
+static int compara_linhas(const void *a, const void *b)
+{
+	const linha_t *la = a, *lb = b;
+	
+	if(la->tarefa != lb->tarefa)
+	{
+		return la->tarefa - lb->tarefa;
+	}
+	return (lb->contagem > la->contagem) - (lb->contagem < la->contagem);
+}
+
+/* le os simbolos de codigo (secao .text) do ELF, ordenados por endereco */
+static int le_simbolos(const char *elf, const char *nm)
+{
+	char comando[1024], linha[512], tipo, nome[400];
+	unsigned long endereco;
+	int capacidade = 1024;
+	FILE *saida;
+	
+	snprintf(comando, sizeof(comando), "%s --defined-only \"%s\"", nm, elf);
+	saida = popen(comando, "r");
+	if(saida == NULL)
+	{
+		perror(nm);
+		return -1;
+	}
+	
+	simbolos = malloc(capacidade * sizeof(simbolo_t));
+	while(fgets(linha, sizeof(linha), saida) != NULL)
+	{
+		if(sscanf(linha, "%lx %c %399s", &endereco, &tipo, nome) != 3 ||
+			(tipo != 'T' && tipo != 't' && tipo != 'W' && tipo != 'w'))
+		{
+			continue;
+		}
+		if(numero_simbolos == capacidade)
+		{
+			capacidade *= 2;
+			simbolos = realloc(simbolos, capacidade * sizeof(simbolo_t));
+		}
+		/* o bit 0 dos enderecos de funcoes Thumb indica o modo, nao faz parte do endereco */
+		simbolos[numero_simbolos].endereco = (uint32_t)endereco & ~1ul;
+		simbolos[numero_simbolos].nome = strdup(nome);
+		numero_simbolos++;
+	}
+	
+	if(pclose(saida) != 0 || numero_simbolos == 0)
+	{
+		fprintf(stderr, "%s: nenhum simbolo lido com %s\n", elf, nm);
+		return -1;
+	}
+	
+	qsort(simbolos, numero_simbolos, sizeof(simbolo_t), compara_simbolos);
+	return 0;
+}
+
+/* endereco completo do PC de uma amostra: o bit PERFIL_PC_RAM indica a SRAM */
+static uint32_t pc_da_amostra(uint32_t amostra)
+{
+	uint32_t pc = amostra & PERFIL_PC_MASCARA & ~1ul;
+	
+	return (amostra & PERFIL_PC_RAM) ? (PERFIL_INICIO_RAM | pc) : pc;
+}
+
+/* busca binaria da funcao que contem o endereco, -1 se antes do primeiro simbolo da 
+   mesma regiao de memoria (um PC na SRAM nao e de uma funcao da flash) */
+static int busca_simbolo(uint32_t pc)
+{
+	int inicio = 0, fim = numero_simbolos - 1, encontrado = -1;
+	
+	while(inicio <= fim)
+	{
+		int meio = (inicio + fim) / 2;
+		if(simbolos[meio].endereco <= pc)
+		{
+			encontrado = meio;
+			inicio = meio + 1;
+		}else
+		{
+			fim = meio - 1;
+		}
+	}
+	if(encontrado >= 0 && ((simbolos[encontrado].endereco ^ pc) & MASCARA_REGIAO) != 0)
+	{
+		return -1;
+	}
+	return encontrado;
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *arquivo;
+	uint8_t cabecalho[TAM_CABECALHO], *registros;
+	uint16_t tamanho;
+	uint32_t amostras, quantidade, i, total_tarefa[256] = {0};
+	linha_t *linhas;
+	int numero_linhas = 0, l;
+	
+	if(argc < 3)
+	{
+		fprintf(stderr, "uso: %s perfil.bin arquivo.elf [nm]\n", argv[0]);
+		return 1;
+	}
+	
+	arquivo = fopen(argv[1], "rb");
+	if(arquivo == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	if(fread(cabecalho, 1, TAM_CABECALHO, arquivo) != TAM_CABECALHO || le32(cabecalho) != PERFIL_ASSINATURA)
+	{
+		fprintf(stderr, "%s: nao e um perfil do rtos\n", argv[1]);
+		fclose(arquivo);
+		return 1;
+	}
+	tamanho = le16(cabecalho + 4);
+	amostras = le32(cabecalho + 8);
+	quantidade = (amostras < tamanho) ? amostras : tamanho;
+	
+	registros = malloc((size_t)tamanho * 4);
+	if(registros == NULL || fread(registros, 4, tamanho, arquivo) != tamanho)
+	{
+		fprintf(stderr, "%s: perfil incompleto\n", argv[1]);
+		fclose(arquivo);
+		free(registros);
+		return 1;
+	}
+	fclose(arquivo);
+	
+	if(le_simbolos(argv[2], (argc > 3) ? argv[3] : "arm-none-eabi-nm") != 0)
+	{
+		free(registros);
+		return 1;
+	}
+	
+	/* conta as amostras por tarefa e funcao (com o buffer cheio, todas as posicoes sao validas) */
+	linhas = calloc(quantidade + 1, sizeof(linha_t));
+	for(i = 0; i < quantidade; i++)
+	{
+		uint32_t amostra = le32(registros + i * 4);
+		uint8_t tarefa = (uint8_t)(amostra >> 24);
+		int simbolo = busca_simbolo(pc_da_amostra(amostra));
+		
+		for(l = 0; l < numero_linhas; l++)
+		{
+			if(linhas[l].tarefa == tarefa && linhas[l].simbolo == simbolo)
+			{
+				break;
+			}
+		}
+		if(l == numero_linhas)
+		{
+			linhas[l].tarefa = tarefa;
+			linhas[l].simbolo = simbolo;
+			numero_linhas++;
+		}
+		linhas[l].contagem++;
+		total_tarefa[tarefa]++;
+	}
+	
+	qsort(linhas, numero_linhas, sizeof(linha_t), compara_linhas);
+	
+	printf("%u amostras (%u feitas)\n", quantidade, amostras);
+	for(l = 0; l < numero_linhas; l++)
+	{
+		if(l == 0 || linhas[l].tarefa != linhas[l - 1].tarefa)
+		{
+			printf("\ntarefa %u: %u amostras (%.1f%%)\n", linhas[l].tarefa, total_tarefa[linhas[l].tarefa],
+				100.0 * total_tarefa[linhas[l].tarefa] / quantidade);
+		}
+		printf("  %8u  %5.1f%%  %s\n", linhas[l].contagem, 100.0 * linhas[l].contagem / total_tarefa[linhas[l].tarefa],
+			linhas[l].simbolo >= 0 ? simbolos[linhas[l].simbolo].nome : "?");
+	}
+	
+	free(linhas);
+	free(registros);
+	return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * rastro2json.c
+ *
+ * Converte o rastro do escalonamento (variavel Rastro do rtos, cfg_RASTRO = 1)
+ * copiado da RAM do microcontrolador para o formato JSON do Chrome Trace, que pode
+ * ser visto como linha do tempo em chrome://tracing ou https://ui.perfetto.dev
+ *
+ * Compilar:  gcc -O2 -o rastro2json rastro2json.c
+ * Usar:      rastro2json rastro.bin [id=nome ...] > rastro.json
+ *
+ * O arquivo rastro.bin e a copia binaria da variavel Rastro, por exemplo no gdb:
+ *            dump binary value rastro.bin Rastro
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* mesmos valores de evento_rastro_t (rtos.h) */
+enum
+{
+	RASTRO_ENTRA = 1,
+	RASTRO_SAI,
+	RASTRO_MARCA,
+	RASTRO_SEMAFORO_LIBERA,
+	RASTRO_SEMAFORO_AGUARDA,
+	RASTRO_SEMAFORO_BLOQUEIA,
+	RASTRO_ISR_ENTRA,
+	RASTRO_ISR_SAI
+};
+
+#define RASTRO_ASSINATURA	0x52545352ul
+#define TAM_CABECALHO		20		/* assinatura, freq_hz, ciclos_marca, tamanho, indice, gravados */
+#define TAM_REGISTRO		8
+#define TID_ISR				1000	/* as interrupcoes aparecem em linhas separadas das tarefas */
+
+static const char *nomes[256];
+
+/* le valores little-endian, como estao na memoria do Cortex-M */
+static uint32_t le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void nome_tarefa(char *nome, size_t tam, uint8_t tarefa)
+{
+	if(nomes[tarefa] != NULL)
+	{
+		snprintf(nome, tam, "%s", nomes[tarefa]);
+	}else
+	{
+		snprintf(nome, tam, "Tarefa %u", tarefa);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *arquivo;
+	uint8_t cabecalho[TAM_CABECALHO], *registros;
+	uint32_t freq_hz, ciclos_marca, gravados, quantidade, primeiro, i;
+	uint16_t tamanho, indice;
+	uint64_t ciclos = 0;
+	uint32_t anterior = 0;
+	int primeiro_evento = 1, a;
+	char nome[64];
+	
+	if(argc < 2)
+	{
+		fprintf(stderr, "uso: %s rastro.bin [id=nome ...] > rastro.json\n", argv[0]);
+		return 1;
+	}
+	
+	for(a = 2; a < argc; a++)
+	{
+		char *igual = strchr(argv[a], '=');
+		if(igual != NULL && atoi(argv[a]) >= 0 && atoi(argv[a]) < 256)
+		{
+			nomes[atoi(argv[a])] = igual + 1;
+		}
+	}
+	
+	arquivo = fopen(argv[1], "rb");
+	if(arquivo == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	
+	if(fread(cabecalho, 1, TAM_CABECALHO, arquivo) != TAM_CABECALHO || le32(cabecalho) != RASTRO_ASSINATURA)
+	{
+		fprintf(stderr, "%s: nao e um rastro do rtos\n", argv[1]);
+		fclose(arquivo);
+		return 1;
+	}
+	
+	freq_hz = le32(cabecalho + 4);
+	ciclos_marca = le32(cabecalho + 8);
+	tamanho = le16(cabecalho + 12);
+	indice = le16(cabecalho + 14);
+	gravados = le32(cabecalho + 16);
+	
+	if(freq_hz == 0 || tamanho == 0 || indice >= tamanho)
+	{
+		fprintf(stderr, "%s: cabecalho invalido\n", argv[1]);
+		fclose(arquivo);
+		return 1;
+	}
+	
+	registros = malloc((size_t)tamanho * TAM_REGISTRO);
+	if(registros == NULL || fread(registros, TAM_REGISTRO, tamanho, arquivo) != tamanho)
+	{
+		fprintf(stderr, "%s: rastro incompleto\n", argv[1]);
+		fclose(arquivo);
+		free(registros);
+		return 1;
+	}
+	fclose(arquivo);
+	
+	/* se o buffer deu a volta, o registro mais antigo e o proximo a ser escrito */
+	if(gravados > tamanho)
+	{
+		quantidade = tamanho;
+		primeiro = indice;
+	}else
+	{
+		quantidade = gravados;
+		primeiro = 0;
+	}
+	
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	
+	for(i = 0; i < quantidade; i++)
+	{
+		const uint8_t *r = registros + ((primeiro + i) % tamanho) * TAM_REGISTRO;
+		uint32_t tempo = le32(r);
+		uint8_t evento = r[4];
+		uint8_t tarefa = r[5];
+		uint16_t dado = le16(r + 6);
+		double us;
+		
+		/* converte o tempo em ciclos absolutos, tratando a volta dos contadores */
+		if(ciclos_marca == 0)
+		{
+			ciclos += primeiro_evento ? tempo : (uint32_t)(tempo - anterior);
+		}else
+		{
+			uint16_t marca = (uint16_t)(tempo >> 16), marca_anterior = (uint16_t)(anterior >> 16);
+			uint64_t base = primeiro_evento ? 0 : (ciclos / ciclos_marca);
+			
+			base += primeiro_evento ? marca : (uint16_t)(marca - marca_anterior);
+			ciclos = base * ciclos_marca + (tempo & 0xFFFF);
+		}
+		anterior = tempo;
+		us = (double)ciclos * 1e6 / freq_hz;
+		
+		printf("%s", primeiro_evento ? "" : ",\n");
+		primeiro_evento = 0;
+		
+		nome_tarefa(nome, sizeof(nome), tarefa);
+		switch(evento)
+		{
+			case RASTRO_ENTRA:
+			case RASTRO_SAI:
+				printf("{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+					nome, evento == RASTRO_ENTRA ? "B" : "E", tarefa, us);
+				break;
+			case RASTRO_MARCA:
+				printf("{\"name\":\"marca %u\",\"ph\":\"i\",\"s\":\"p\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+					dado, tarefa, us);
+				break;
+			case RASTRO_SEMAFORO_LIBERA:
+			case RASTRO_SEMAFORO_AGUARDA:
+			case RASTRO_SEMAFORO_BLOQUEIA:
+				printf("{\"name\":\"semaforo %s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+					"\"args\":{\"semaforo\":\"0x%04x\"}}",
+					evento == RASTRO_SEMAFORO_LIBERA ? "libera" : 
+					(evento == RASTRO_SEMAFORO_AGUARDA ? "recebe" : "bloqueia"), tarefa, us, dado);
+				break;
+			case RASTRO_ISR_ENTRA:
+			case RASTRO_ISR_SAI:
+				printf("{\"name\":\"ISR %u\",\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+					dado, evento == RASTRO_ISR_ENTRA ? "B" : "E", TID_ISR + dado, us);
+				break;
+			default:
+				printf("{\"name\":\"evento %u\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+					"\"args\":{\"dado\":%u}}", evento, tarefa, us, dado);
+				break;
+		}
+	}
+	
+	/* nomes das linhas do tempo de cada tarefa */
+	for(a = 0; a < 256; a++)
+	{
+		if(nomes[a] != NULL)
+		{
+			printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				primeiro_evento ? "" : ",\n", a, nomes[a]);
+			primeiro_evento = 0;
+		}
+	}
+	
+	printf("\n]}\n");
+	
+	free(registros);
+	return 0;
+}